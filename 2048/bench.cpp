@@ -0,0 +1,300 @@
+#include "game.h"
+#include "mcts.h"
+#include "expectimax.h"
+#include "ntuple.h"
+#include "record.h"
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <memory>
+#include <cstring>
+#include <cstdlib>
+
+// headless self-play benchmark, plays games with seeds [seed, seed + games)
+// and reports throughput, strength and per move latency
+
+struct BenchConfig
+{
+	int games;
+	int seed;
+	int size;
+	int jobs;
+	int threads;
+	int transTableMB;
+	int rolloutPolicy;
+	int parallelMode;
+	bool sharedPool;
+	bool useExpectimax;
+	const char *ntupleFile;
+	const char *recordFile;
+};
+
+struct GameResult
+{
+	int maxValue;
+	bool win;
+	int moves;
+	long long iterations;
+	vector<float> latencies;
+};
+
+static void PrintUsage()
+{
+	printf("usage: bench [--games N] [--seed S] [--size N] [--jobs J] [--threads T] [--engine mcts|expectimax] [--tt-mb M] [--rollout naive|greedy|epsilon] [--parallel tree|root] [--pool shared|private] [--ntuple FILE] [--record FILE]\n");
+	printf("  --games   number of games to play (default 10)\n");
+	printf("  --seed    seed of the first game, game i uses seed + i (default 1)\n");
+	printf("  --size    board size from %d to %d, expectimax, n-tuple and records need the 4x4 board (default %d)\n", BOARD_SIZE_MIN, BOARD_SIZE_MAX, BOARD_SIZE);
+	printf("  --jobs    games played at the same time, one engine per job (default 1)\n");
+	printf("  --threads search threads per engine, 0 for hardware concurrency (default 0)\n");
+	printf("  --tt-mb   transposition table size of each MCTS engine (default %d)\n", TRANS_TABLE_SIZE_MB);
+	printf("  --rollout rollout policy of MCTS (default naive)\n");
+	printf("  --parallel tree: threads share one tree, root: private trees merged at the root (default tree)\n");
+	printf("  --pool    shared: all jobs search on one pool of --threads workers, private: threads per engine (default shared)\n");
+	printf("  --ntuple  n-tuple weights used by MCTS instead of rollouts\n");
+	printf("  --record  append the moves of all games to a binary game record file\n");
+	printf("run several processes with disjoint seed ranges to benchmark across processes\n");
+}
+
+static bool ParseArgs(int argc, char *argv[], BenchConfig &config)
+{
+	config.games = 10;
+	config.seed = 1;
+	config.size = BOARD_SIZE;
+	config.jobs = 1;
+	config.threads = 0;
+	config.transTableMB = TRANS_TABLE_SIZE_MB;
+	config.rolloutPolicy = GameBase::E_ROLLOUT_NAIVE;
+	config.parallelMode = MCTS::E_TREE_PARALLEL;
+	config.sharedPool = true;
+	config.useExpectimax = false;
+	config.ntupleFile = NULL;
+	config.recordFile = NULL;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (i + 1 >= argc)
+			return false;
+
+		const char *arg = argv[i];
+		const char *value = argv[++i];
+
+		if (strcmp(arg, "--games") == 0)
+			config.games = atoi(value);
+		else if (strcmp(arg, "--seed") == 0)
+			config.seed = atoi(value);
+		else if (strcmp(arg, "--size") == 0)
+			config.size = atoi(value);
+		else if (strcmp(arg, "--jobs") == 0)
+			config.jobs = atoi(value);
+		else if (strcmp(arg, "--threads") == 0)
+			config.threads = atoi(value);
+		else if (strcmp(arg, "--tt-mb") == 0)
+			config.transTableMB = atoi(value);
+		else if (strcmp(arg, "--rollout") == 0 && strcmp(value, "naive") == 0)
+			config.rolloutPolicy = GameBase::E_ROLLOUT_NAIVE;
+		else if (strcmp(arg, "--rollout") == 0 && strcmp(value, "greedy") == 0)
+			config.rolloutPolicy = GameBase::E_ROLLOUT_GREEDY;
+		else if (strcmp(arg, "--rollout") == 0 && strcmp(value, "epsilon") == 0)
+			config.rolloutPolicy = GameBase::E_ROLLOUT_EPSILON_GREEDY;
+		else if (strcmp(arg, "--parallel") == 0 && strcmp(value, "tree") == 0)
+			config.parallelMode = MCTS::E_TREE_PARALLEL;
+		else if (strcmp(arg, "--parallel") == 0 && strcmp(value, "root") == 0)
+			config.parallelMode = MCTS::E_ROOT_PARALLEL;
+		else if (strcmp(arg, "--pool") == 0 && strcmp(value, "shared") == 0)
+			config.sharedPool = true;
+		else if (strcmp(arg, "--pool") == 0 && strcmp(value, "private") == 0)
+			config.sharedPool = false;
+		else if (strcmp(arg, "--ntuple") == 0)
+			config.ntupleFile = value;
+		else if (strcmp(arg, "--record") == 0)
+			config.recordFile = value;
+		else if (strcmp(arg, "--engine") == 0 && strcmp(value, "mcts") == 0)
+			config.useExpectimax = false;
+		else if (strcmp(arg, "--engine") == 0 && strcmp(value, "expectimax") == 0)
+			config.useExpectimax = true;
+		else
+			return false;
+	}
+
+	if (config.size < BOARD_SIZE_MIN || config.size > BOARD_SIZE_MAX)
+		return false;
+	if (config.size != BOARD_SIZE && (config.useExpectimax || config.ntupleFile != NULL || config.recordFile != NULL))
+		return false;
+	return config.games > 0 && config.jobs > 0;
+}
+
+template <int N>
+static void PlayGame(SearchEngineN<N> *ai, int seed, RecordWriter *recorder, GameResult &result)
+{
+	ai->SetSeed(seed);
+
+	GameN<N> g(seed);
+	if (recorder != NULL)
+		g.SetRecorder(recorder);
+	result.moves = 0;
+	result.iterations = 0;
+
+	while (!g.IsGameFinish())
+	{
+		auto start = chrono::steady_clock::now();
+		int move = ai->Search(&g);
+		chrono::duration<float, milli> latency = chrono::steady_clock::now() - start;
+
+		result.latencies.push_back(latency.count());
+		result.iterations += ai->GetLastStats().iteration;
+
+		if (!g.Move(move))
+			break;
+
+		++result.moves;
+	}
+
+	result.maxValue = g.GetMaxValue();
+	result.win = (g.GetState() == GameTypes::E_WIN);
+}
+
+using JobFunc = void (*)(const BenchConfig*, const NTuple*, SearchScheduler*, RecordWriter*, atomic<int>*, vector<GameResult>*);
+
+template <int N>
+static void JobThread(const BenchConfig *config, const NTuple *network, SearchScheduler *scheduler, RecordWriter *recorder, atomic<int> *nextGame, vector<GameResult> *results)
+{
+	// only the engine in use is built, an idle MCTS would still hold its arenas, table and threads.
+	// expectimax searches the 4x4 bitboard only
+	unique_ptr<SearchEngineN<N>> ai;
+	if constexpr (N == BOARD_SIZE)
+	{
+		if (config->useExpectimax)
+			ai.reset(new Expectimax());
+	}
+
+	if (!ai)
+	{
+		MCTSN<N> *mcts = new MCTSN<N>(config->parallelMode, config->threads, config->transTableMB, scheduler);
+		mcts->SetRolloutPolicy(config->rolloutPolicy);
+		mcts->SetEvaluator(network);
+		ai.reset(mcts);
+	}
+	ai->SetVerbose(false);
+
+	int game;
+	while ((game = (*nextGame)++) < config->games)
+	{
+		PlayGame(ai.get(), config->seed + game, recorder, (*results)[game]);
+		printf("game %d: max tile %d, moves %d\n", config->seed + game, 1 << (*results)[game].maxValue, (*results)[game].moves);
+	}
+}
+
+// the jobs and the goal of the games of one board size
+template <int N>
+static void SelectSize(JobFunc &job, int &winCondition)
+{
+	job = JobThread<N>;
+	winCondition = GameBaseN<N>::WIN_CONDITION;
+}
+
+static float Percentile(const vector<float> &sorted, float p)
+{
+	if (sorted.empty())
+		return 0;
+
+	int id = clamp(int(p * (sorted.size() - 1) + 0.5f), 0, (int)sorted.size() - 1);
+	return sorted[id];
+}
+
+int main(int argc, char *argv[])
+{
+	BenchConfig config;
+	if (!ParseArgs(argc, argv, config))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	// the weights are shared read only by all jobs
+	NTuple network;
+	if (config.ntupleFile != NULL && !network.Load(config.ntupleFile))
+	{
+		printf("failed to load n-tuple weights from %s\n", config.ntupleFile);
+		return 1;
+	}
+
+	// one pool for the searches of all jobs, a single job keeps its engine's own threads
+	unique_ptr<SearchScheduler> scheduler;
+	if (config.sharedPool && config.jobs > 1 && !config.useExpectimax)
+		scheduler.reset(new SearchScheduler(config.threads));
+
+	// the records of all jobs go to one file, each game under an id of its own
+	RecordWriter recorder;
+	if (config.recordFile != NULL && !recorder.Open(config.recordFile))
+	{
+		printf("failed to open game record file %s\n", config.recordFile);
+		return 1;
+	}
+
+	JobFunc job;
+	int winCondition;
+	switch (config.size)
+	{
+	case 3: SelectSize<3>(job, winCondition); break;
+	case 5: SelectSize<5>(job, winCondition); break;
+	case 6: SelectSize<6>(job, winCondition); break;
+	default: SelectSize<BOARD_SIZE>(job, winCondition); break;
+	}
+
+	vector<GameResult> results(config.games);
+	atomic<int> nextGame(0);
+
+	auto start = chrono::steady_clock::now();
+
+	vector<thread> jobs;
+	for (int i = 0; i < min(config.jobs, config.games); ++i)
+		jobs.push_back(thread(job, &config, &network, scheduler.get(), recorder.IsOpen() ? &recorder : NULL, &nextGame, &results));
+
+	for (auto &job : jobs)
+		job.join();
+
+	float totalTime = chrono::duration<float>(chrono::steady_clock::now() - start).count();
+
+	// aggregate
+	int wins = 0, moves = 0;
+	long long iterations = 0;
+	array<int, 32> maxTiles = {};
+	vector<float> latencies;
+
+	for (auto &result : results)
+	{
+		wins += result.win ? 1 : 0;
+		moves += result.moves;
+		iterations += result.iterations;
+		maxTiles[result.maxValue]++;
+		latencies.insert(latencies.end(), result.latencies.begin(), result.latencies.end());
+	}
+	sort(latencies.begin(), latencies.end());
+
+	printf("\n===== Benchmark =====\n");
+	printf("engine: %s, board: %dx%d, games: %d, seeds: %d-%d, jobs: %d, threads: %d, pool: %s\n", config.useExpectimax ? "expectimax" : "mcts",
+		config.size, config.size, config.games, config.seed, config.seed + config.games - 1, config.jobs, config.threads, scheduler ? "shared" : "private");
+	if (scheduler)
+		printf("pool threads: %d, steals: %lld\n", scheduler->GetThreadNum(), scheduler->GetSteals());
+	printf("time: %.2f s, games/s: %.4f, moves/s: %.1f, %s/s: %.0f\n", totalTime, config.games / totalTime, moves / totalTime,
+		config.useExpectimax ? "nodes" : "rollouts", iterations / totalTime);
+	printf("win rate: %.2f%% (%d/%d), win condition: %d\n", wins * 100.f / config.games, wins, config.games, 1 << winCondition);
+
+	printf("max tile:");
+	for (int i = 0; i < (int)maxTiles.size(); ++i)
+	{
+		if (maxTiles[i] > 0)
+			printf(" %d: %d (%.1f%%)", 1 << i, maxTiles[i], maxTiles[i] * 100.f / config.games);
+	}
+	printf("\n");
+
+	float latencySum = 0;
+	for (float latency : latencies)
+		latencySum += latency;
+
+	printf("move latency ms: mean %.2f, p50 %.2f, p90 %.2f, p99 %.2f, max %.2f\n", latencySum / max((int)latencies.size(), 1),
+		Percentile(latencies, 0.5f), Percentile(latencies, 0.9f), Percentile(latencies, 0.99f), latencies.empty() ? 0.f : latencies.back());
+
+	return 0;
+}
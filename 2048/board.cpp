@@ -0,0 +1,221 @@
+#include "board.h"
+
+const uint64_t ROW_MASK = 0xffffULL;
+const uint64_t GRID_LOW_BITS = 0x1111111111111111ULL;
+
+// generated while compiling, so the tables are ready before any board exists and sit in read only memory
+using BoardLineTable = LineTable<BOARD_SIZE>;
+
+Board::Board()
+{
+	Clear();
+}
+
+void Board::Clear()
+{
+	maxValue = 0;
+	grids = 0;
+}
+
+void Board::PrintHSplitLine(FILE *fp) const
+{
+	fprintf(fp, " ");
+	for (int i = 0; i < BOARD_SIZE; ++i)
+	{
+		fprintf(fp, "------ ");
+	}
+	fprintf(fp, "\n");
+}
+
+void Board::PrintVSplitLine(FILE *fp) const
+{
+	fprintf(fp, "|");
+	for (int i = 0; i < BOARD_SIZE; ++i)
+	{
+		fprintf(fp, "      |");
+	}
+	fprintf(fp, "\n");
+}
+
+void Board::Print(FILE *fp) const
+{
+	PrintHSplitLine(fp);
+
+	int id = 0;
+	for (int i = 0; i < BOARD_SIZE; ++i)
+	{
+		PrintVSplitLine(fp);
+		fprintf(fp, "|");
+
+		for (int j = 0; j < BOARD_SIZE; ++j)
+		{
+			int grid = GetGrid(id++);
+			if (grid > 0)
+			{
+				int num = 1 << (grid);
+
+				if (num >= 100)
+					fprintf(fp, " %4d |", num);
+				else
+					fprintf(fp, " %3d  |", num);
+			}
+			else
+				fprintf(fp, "      |");
+		}
+		fprintf(fp, "\n");
+		PrintVSplitLine(fp);
+		PrintHSplitLine(fp);
+	}
+}
+
+// swap rows and columns, so that up/down can reuse the left/right line dict
+uint64_t Board::Transpose(uint64_t x)
+{
+	uint64_t a1 = x & 0xF0F00F0FF0F00F0FULL;
+	uint64_t a2 = x & 0x0000F0F00000F0F0ULL;
+	uint64_t a3 = x & 0x0F0F00000F0F0000ULL;
+	uint64_t a = a1 | (a2 << 12) | (a3 >> 12);
+	uint64_t b1 = a & 0xFF00FF0000FF00FFULL;
+	uint64_t b2 = a & 0x00FF00FF00000000ULL;
+	uint64_t b3 = a & 0x00000000FF00FF00ULL;
+	return b1 | (b2 >> 24) | (b3 << 24);
+}
+
+// the tables are indexed by a row exactly as it is stored in the board,
+// so a row can be moved with a single lookup and no unpacking
+uint64_t Board::MoveLines(uint64_t x, bool right, int &maxValue)
+{
+	const auto &dict = right ? BoardLineTable::right : BoardLineTable::left;
+
+	uint64_t result = 0;
+	for (int i = 0; i < BOARD_SIZE; ++i)
+	{
+		int shift = i * 16;
+		int line = dict[(x >> shift) & ROW_MASK];
+		maxValue = max(maxValue, (int)BoardLineTable::maxValue[line]);
+		result |= (uint64_t)line << shift;
+	}
+	return result;
+}
+
+bool Board::CheckLines(uint64_t x, bool right)
+{
+	int flag = right ? LINE_CHANGE_RIGHT : LINE_CHANGE_LEFT;
+	for (int i = 0; i < BOARD_SIZE; ++i)
+	{
+		if (BoardLineTable::change[(x >> (i * 16)) & ROW_MASK] & flag)
+			return true;
+	}
+	return false;
+}
+
+// sum of the merged tiles, moving right is scored as moving left on the reversed line
+int Board::ScoreLines(uint64_t x, bool reverse)
+{
+	int score = 0;
+	for (int i = 0; i < BOARD_SIZE; ++i)
+	{
+		int line = (x >> (i * 16)) & ROW_MASK;
+		score += BoardLineTable::score[reverse ? ReverseLine<BOARD_SIZE>(line) : line];
+	}
+	return score;
+}
+
+bool Board::Move(Direction d)
+{
+	uint64_t result;
+	switch (d)
+	{
+	case Board::E_UP:
+		result = Board::Transpose(Board::MoveLines(Board::Transpose(grids), false, maxValue));
+		break;
+	case Board::E_LEFT:
+		result = Board::MoveLines(grids, false, maxValue);
+		break;
+	case Board::E_RIGHT:
+		result = Board::MoveLines(grids, true, maxValue);
+		break;
+	case Board::E_DOWN:
+		result = Board::Transpose(Board::MoveLines(Board::Transpose(grids), true, maxValue));
+		break;
+	default:
+		return false;
+	}
+
+	bool isChange = (result != grids);
+	grids = result;
+	return isChange;
+}
+
+bool Board::Check(Direction d) const
+{
+	switch (d)
+	{
+	case Board::E_UP:
+		return Board::CheckLines(Board::Transpose(grids), false);
+	case Board::E_LEFT:
+		return Board::CheckLines(grids, false);
+	case Board::E_RIGHT:
+		return Board::CheckLines(grids, true);
+	case Board::E_DOWN:
+		return Board::CheckLines(Board::Transpose(grids), true);
+	default:
+		return false;
+	}
+}
+
+int Board::GetMoveScore(Direction d) const
+{
+	switch (d)
+	{
+	case Board::E_UP:
+		return Board::ScoreLines(Board::Transpose(grids), false);
+	case Board::E_LEFT:
+		return Board::ScoreLines(grids, false);
+	case Board::E_RIGHT:
+		return Board::ScoreLines(grids, true);
+	case Board::E_DOWN:
+		return Board::ScoreLines(Board::Transpose(grids), true);
+	default:
+		return 0;
+	}
+}
+
+// lowest bit of each empty grid is set
+uint64_t Board::EmptyMask() const
+{
+	uint64_t x = grids;
+	x |= x >> 2;
+	x |= x >> 1;
+	return ~x & GRID_LOW_BITS;
+}
+
+int Board::CountEmpty() const
+{
+	uint64_t x = EmptyMask();
+	x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+	return (int)((x * 0x0101010101010101ULL) >> 56);
+}
+
+int Board::GetGrid(int id) const
+{
+	return (grids >> (id * 4)) & 0xf;
+}
+
+void Board::SetGrid(int id, int value)
+{
+	int shift = id * 4;
+	grids = (grids & ~(0xfULL << shift)) | ((uint64_t)value << shift);
+	maxValue = max(maxValue, value);
+}
+
+int Board::Coord2Id(int row, int col)
+{
+	return row * BOARD_SIZE + col;
+}
+
+void Board::Id2Coord(int id, int &row, int &col)
+{
+	row = id / BOARD_SIZE;
+	col = id % BOARD_SIZE;
+}
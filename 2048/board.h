@@ -0,0 +1,74 @@
+#pragma once
+#include <iostream>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <array>
+#include <list>
+#include <algorithm>
+#include <cstdint>
+#include "linetable.h"
+
+#ifdef _MSC_VER
+#pragma warning (disable:4244)
+#pragma warning (disable:4018)
+#endif
+
+using namespace std;
+
+const int BOARD_SIZE = 4;
+const int GRID_NUM = BOARD_SIZE * BOARD_SIZE;
+const int LINE_DICT_SIZE = LineTable<BOARD_SIZE>::SIZE;
+
+using std::max;
+using std::min;
+using std::clamp;
+
+class Board
+{
+public:
+	enum Side
+	{
+		E_PLAYER,
+		E_SYSTEM,
+	};
+
+	enum Direction
+	{
+		E_UP,
+		E_LEFT,
+		E_RIGHT,
+		E_DOWN,
+		E_DIRECTION_MAX,
+	};
+
+	Board();
+
+	void Clear();
+	void Print(FILE *fp = stdout) const;
+	bool Move(Direction d);
+	bool Check(Direction d) const;
+	int GetMoveScore(Direction d) const;
+	int CountEmpty() const;
+	uint64_t EmptyMask() const;	// MASK_STEP bits per grid, the lowest one is set if the grid is empty
+	int GetGrid(int id) const;
+	void SetGrid(int id, int value);
+
+	static const int MASK_STEP = 4;
+
+	// 4 bits per grid, grid id i is stored at bits [4i, 4i + 4)
+	uint64_t grids;
+	int maxValue;
+
+	static int Coord2Id(int row, int col);
+	static void Id2Coord(int id, int &row, int &col);
+	static uint64_t Transpose(uint64_t x);
+
+private:
+	static uint64_t MoveLines(uint64_t x, bool right, int &maxValue);
+	static bool CheckLines(uint64_t x, bool right);
+	static int ScoreLines(uint64_t x, bool reverse);
+
+	void PrintHSplitLine(FILE *fp) const;
+	void PrintVSplitLine(FILE *fp) const;
+};
@@ -0,0 +1,216 @@
+#pragma once
+#include <type_traits>
+#include "board.h"
+
+const int BOARD_SIZE_MIN = 3;
+const int BOARD_SIZE_MAX = 6;
+
+// board of any size from 3 to 6, one packed line per row (column 0 in the lowest bits).
+// small sizes move a line with one table lookup, larger ones where 16^N tables no longer fit in cache
+// merge the line directly. the 4x4 Board stays the fast path of the 4x4 game
+template <int N, bool TABLE = (N <= 4)>
+class BoardN
+{
+public:
+	static_assert(N >= BOARD_SIZE_MIN && N <= BOARD_SIZE_MAX, "boards from 3x3 to 6x6 are supported");
+	static_assert(!TABLE || N <= 4, "line tables are only built for lines of up to 4 grids");
+
+	// a 4 bit grid stops merging at 32768 like the 4x4 bitboard, which a 3x3 board never reaches,
+	// a 6x6 board can reach 2^37 so boards from 5x5 up store 6 bits per grid
+	static constexpr int CELL_BITS = (N <= 4) ? 4 : 6;
+	static constexpr int CELL_MAX = (1 << CELL_BITS) - 1;
+	static constexpr int GRID_NUM = N * N;
+	using Line = conditional_t<(N * CELL_BITS <= 16), uint16_t, conditional_t<(N * CELL_BITS <= 32), uint32_t, uint64_t>>;
+
+	BoardN() { Clear(); }
+
+	void Clear()
+	{
+		grids.fill(0);
+		maxValue = 0;
+	}
+
+	bool Move(Board::Direction d)
+	{
+		bool isChange = false;
+		bool right = (d == Board::E_RIGHT || d == Board::E_DOWN);
+
+		for (int i = 0; i < N; ++i)
+		{
+			Line line = (d == Board::E_LEFT || d == Board::E_RIGHT) ? grids[i] : GetColumn(i);
+			Line result = MoveLine(line, right);
+			if (result == line)
+				continue;
+
+			isChange = true;
+			maxValue = max(maxValue, LineMax(result));
+			if (d == Board::E_LEFT || d == Board::E_RIGHT)
+				grids[i] = result;
+			else
+				SetColumn(i, result);
+		}
+		return isChange;
+	}
+
+	bool Check(Board::Direction d) const
+	{
+		bool right = (d == Board::E_RIGHT || d == Board::E_DOWN);
+		for (int i = 0; i < N; ++i)
+		{
+			Line line = (d == Board::E_LEFT || d == Board::E_RIGHT) ? grids[i] : GetColumn(i);
+			if (MoveLine(line, right) != line)
+				return true;
+		}
+		return false;
+	}
+
+	int CountEmpty() const
+	{
+		int count = 0;
+		for (int i = 0; i < GRID_NUM; ++i)
+			count += GetGrid(i) == 0;
+		return count;
+	}
+
+	// bit i is set if grid i is empty
+	uint64_t EmptyMask() const
+	{
+		uint64_t mask = 0;
+		for (int i = 0; i < GRID_NUM; ++i)
+			mask |= uint64_t(GetGrid(i) == 0) << i;
+		return mask;
+	}
+
+	int GetGrid(int id) const
+	{
+		return (grids[id / N] >> (id % N * CELL_BITS)) & CELL_MAX;
+	}
+
+	void SetGrid(int id, int value)
+	{
+		int shift = id % N * CELL_BITS;
+		grids[id / N] = (grids[id / N] & ~(Line(CELL_MAX) << shift)) | (Line(value) << shift);
+		maxValue = max(maxValue, value);
+	}
+
+	void Print(FILE *fp = stdout) const
+	{
+		for (int i = 0; i < N; ++i)
+		{
+			for (int j = 0; j < N; ++j)
+			{
+				int grid = GetGrid(i * N + j);
+				if (grid > 0)
+					fprintf(fp, "%6lld", 1LL << grid);
+				else
+					fprintf(fp, "     .");
+			}
+			fprintf(fp, "\n");
+		}
+	}
+
+	static const int MASK_STEP = 1;
+
+	// one packed line per row, the name matches Board so the game code reads either board
+	array<Line, N> grids;
+	int maxValue;
+
+private:
+	// grid i of a column line is row i, so moving up is moving the column left
+	Line GetColumn(int col) const
+	{
+		Line line = 0;
+		for (int i = 0; i < N; ++i)
+			line |= Line((grids[i] >> (col * CELL_BITS)) & CELL_MAX) << (i * CELL_BITS);
+		return line;
+	}
+
+	void SetColumn(int col, Line line)
+	{
+		int shift = col * CELL_BITS;
+		for (int i = 0; i < N; ++i)
+			grids[i] = (grids[i] & ~(Line(CELL_MAX) << shift)) | (Line((line >> (i * CELL_BITS)) & CELL_MAX) << shift);
+	}
+
+	static int LineMax(Line line)
+	{
+		int result = 0;
+		for (int i = 0; i < N; ++i)
+			result = max(result, int(line >> (i * CELL_BITS)) & CELL_MAX);
+		return result;
+	}
+
+	static Line MoveLine(Line line, bool right)
+	{
+		if constexpr (TABLE)
+			return right ? LineTable<N>::right[line] : LineTable<N>::left[line];
+		else
+			return right ? Reverse(MergeLeft(Reverse(line))) : MergeLeft(line);
+	}
+
+	static Line Reverse(Line line)
+	{
+		Line result = 0;
+		for (int i = 0; i < N; ++i)
+			result |= Line((line >> (i * CELL_BITS)) & CELL_MAX) << ((N - 1 - i) * CELL_BITS);
+		return result;
+	}
+
+	// compacts the line without branching on the grids, then merges equal neighbours in one pass,
+	// CELL_MAX is the largest value a grid can hold so it never merges
+	static Line MergeLeft(Line line)
+	{
+		array<int, N + 1> grids = {};
+		int count = 0;
+		for (int i = 0; i < N; ++i)
+		{
+			int grid = (line >> (i * CELL_BITS)) & CELL_MAX;
+			grids[count] = grid;
+			count += (grid != 0);
+		}
+		grids[count] = 0;
+
+		Line result = 0;
+		int out = 0;
+		for (int i = 0; i < count; ++i)
+		{
+			int merge = (grids[i] == grids[i + 1]) & (grids[i] < CELL_MAX);
+			result |= Line(grids[i] + merge) << (out * CELL_BITS);
+			++out;
+			i += merge;
+		}
+		return result;
+	}
+};
+
+// the board of the game of a size, the 4x4 game keeps its bitboard
+template <int N>
+struct BoardSelect
+{
+	using Type = BoardN<N>;
+};
+
+template <>
+struct BoardSelect<BOARD_SIZE>
+{
+	using Type = Board;
+};
+
+template <int N>
+using BoardOf = typename BoardSelect<N>::Type;
+
+// the grids of a board as one 64 bit key, the 4x4 bitboard is its own key,
+// the rows of a larger board are mixed so different boards rarely share a key
+inline uint64_t FoldGrids(uint64_t grids)
+{
+	return grids;
+}
+
+template <class Line, size_t N>
+inline uint64_t FoldGrids(const array<Line, N> &grids)
+{
+	uint64_t result = 0;
+	for (auto line : grids)
+		result = (result ^ line) * 0x9e3779b97f4a7c15ULL;
+	return result;
+}
@@ -0,0 +1,150 @@
+#include "expectimax.h"
+#include "heuristic.h"
+
+const int	DEPTH_MIN = 1;
+const int	DEPTH_MAX = 8;
+const float	DEPTH_GROWTH_ESTIMATE = 4.f;	// a new depth is started only if it is expected to finish in time
+const float PROBABILITY_THRESHOLD = 0.0001f;
+const float SPAWN_2_PROBABILITY = 0.9f;
+const float WIN_SCORE = 1e9f;
+const int	TIMEOUT_CHECK_INTERVAL = 1024;
+
+Expectimax::Expectimax()
+{
+	searchTime = 0;
+	timeout = false;
+	nodeCount = 0;
+}
+
+int Expectimax::Search(Game *state)
+{
+	GameBase *game = (GameBase*)state;
+	const Board &board = game->board;
+
+	searchTime = CalcSearchTime(CalcTimeRatio(*game));
+
+	startTime = chrono::steady_clock::now();
+	timeout = false;
+	nodeCount = 0;
+
+	int move = -1, depth = 0;
+	float score = 0, lastDepthTime = 0;
+
+	// keep the result of the last depth that finished in time
+	for (int d = DEPTH_MIN; d <= DEPTH_MAX; ++d)
+	{
+		cache.clear();
+
+		float depthStart = GetElapsedTime();
+		float depthScore;
+		int depthMove = SearchRoot(board, d, depthScore);
+
+		if (timeout && move >= 0)
+			break;
+
+		move = depthMove;
+		score = depthScore;
+		depth = d;
+
+		float elapsedTime = GetElapsedTime();
+		lastDepthTime = elapsedTime - depthStart;
+		if (timeout || elapsedTime + lastDepthTime * DEPTH_GROWTH_ESTIMATE > searchTime)
+			break;
+	}
+
+	lastStats.iteration = nodeCount;
+	lastStats.time = GetElapsedTime();
+
+	if (verbose)
+		printf("plan: %.2f, time: %.2f, depth: %d, nodes: %d, score: %.0f\n", searchTime, lastStats.time, depth, nodeCount, score);
+
+	return move;
+}
+
+int Expectimax::SearchRoot(const Board &board, int depth, float &bestScore)
+{
+	int bestMove = -1;
+	bestScore = -1;
+
+	for (int d = 0; d < Board::E_DIRECTION_MAX; ++d)
+	{
+		Board next = board;
+		if (!next.Move((Board::Direction)d))
+			continue;
+
+		float score = (next.maxValue >= WIN_CONDITION) ? WIN_SCORE : SearchChance(next, depth, 1.f);
+		if (score > bestScore)
+		{
+			bestScore = score;
+			bestMove = d;
+		}
+	}
+	return bestMove;
+}
+
+float Expectimax::SearchMax(const Board &board, int depth, float probability)
+{
+	float bestScore = 0; // no valid move, game lost
+
+	for (int d = 0; d < Board::E_DIRECTION_MAX; ++d)
+	{
+		Board next = board;
+		if (!next.Move((Board::Direction)d))
+			continue;
+
+		if (next.maxValue >= WIN_CONDITION)
+			return WIN_SCORE;
+
+		bestScore = max(bestScore, SearchChance(next, depth, probability));
+	}
+	return bestScore;
+}
+
+float Expectimax::SearchChance(const Board &board, int depth, float probability)
+{
+	++nodeCount;
+
+	if (depth <= 0 || probability < PROBABILITY_THRESHOLD || IsTimeout())
+		return Heuristic::Evaluate(board.grids);
+
+	auto it = cache.find(board.grids);
+	if (it != cache.end() && it->second.depth >= depth)
+		return it->second.score;
+
+	int emptyCount = board.CountEmpty();
+	float gridProbability = probability / emptyCount;
+	float score = 0;
+
+	uint64_t mask = board.EmptyMask();
+	for (int i = 0; mask != 0; ++i, mask >>= 4)
+	{
+		if (!(mask & 1))
+			continue;
+
+		Board next = board;
+		next.SetGrid(i, 1);
+		score += SearchMax(next, depth - 1, gridProbability * SPAWN_2_PROBABILITY) * SPAWN_2_PROBABILITY;
+
+		next = board;
+		next.SetGrid(i, 2);
+		score += SearchMax(next, depth - 1, gridProbability * (1 - SPAWN_2_PROBABILITY)) * (1 - SPAWN_2_PROBABILITY);
+	}
+	score /= emptyCount;
+
+	CacheEntry entry = { depth, score };
+	cache[board.grids] = entry;
+	return score;
+}
+
+bool Expectimax::IsTimeout()
+{
+	if (!timeout && nodeCount % TIMEOUT_CHECK_INTERVAL == 0)
+		timeout = GetElapsedTime() > searchTime;
+
+	return timeout;
+}
+
+float Expectimax::GetElapsedTime()
+{
+	return chrono::duration<float>(chrono::steady_clock::now() - startTime).count();
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <unordered_map>
+#include <chrono>
+#include "game.h"
+
+// depth limited expectimax, chance nodes weight every spawn by its real probability
+// and leaves are scored by Heuristic, the depth is deepened until the time budget is used
+class Expectimax : public SearchEngine
+{
+public:
+	Expectimax();
+	int Search(Game *state);
+
+private:
+	struct CacheEntry
+	{
+		int depth;
+		float score;
+	};
+
+	float SearchMax(const Board &board, int depth, float probability);
+	float SearchChance(const Board &board, int depth, float probability);
+	int SearchRoot(const Board &board, int depth, float &bestScore);
+	bool IsTimeout();
+	float GetElapsedTime();
+
+	unordered_map<uint64_t, CacheEntry> cache;
+	chrono::steady_clock::time_point startTime;
+	float searchTime;
+	bool timeout;
+	int nodeCount;
+};
@@ -1,491 +1,240 @@
 #include "game.h"
+#include "heuristic.h"
+#include "movecache.h"
+#include "record.h"
 #include <cmath>
 #include <cstdlib>
 
-#define USE_LINE_DICT 1
-#define OUTPUT_LINE_DICT 0
+const float ROLLOUT_EPSILON = 0.1f;
+const int SPAWN_FOUR_RATIO = 10; // one of this many spawned tiles is a 4
+const float SEARCH_TIME_MIN = 0.05f;
+const float SEARCH_TIME_MAX = 0.2f;
 
-bool Board::isLineDictReady = false;
-array<short, LINE_DICT_SIZE> Board::lineDict;
-
-Board::Board()
-{
-	if (USE_LINE_DICT && !Board::isLineDictReady)
-		Board::InitLineDict();
-
-	Clear();
-}
-
-void Board::Clear()
+const int GameTypes::NAIVE_DIRECTION[NAIVE_ORDER_NUM][Board::E_DIRECTION_MAX] =
 {
-	maxValue = 0;
-	grids.fill(0);
-}
+	{ Board::E_LEFT, Board::E_UP, Board::E_RIGHT, Board::E_DOWN },
+	{ Board::E_UP, Board::E_LEFT, Board::E_RIGHT, Board::E_DOWN },
+	{ Board::E_RIGHT, Board::E_UP, Board::E_LEFT, Board::E_DOWN },
+	{ Board::E_UP, Board::E_RIGHT, Board::E_LEFT, Board::E_DOWN },
+	{ Board::E_RIGHT, Board::E_LEFT, Board::E_UP, Board::E_DOWN },
+	{ Board::E_LEFT, Board::E_RIGHT, Board::E_UP, Board::E_DOWN }
+};
 
-void Board::PrintHSplitLine()
+// an empty board, call Init to place the first two grids
+template <int N>
+GameBaseN<N>::GameBaseN()
 {
-	cout << " ";
-	for (int i = 0; i < BOARD_SIZE; ++i)
-	{
-		printf("------ ");
-	}
-	cout << endl;
-}
+	state = E_NORMAL;
+	turn = 1;
+	lastMove = 0;
+	moveCache = NULL;
 
-void Board::PrintVSplitLine()
-{
-	cout << "|";
-	for (int i = 0; i < BOARD_SIZE; ++i)
-	{
-		printf("      |");
-	}
-	cout << endl;
+	board.Clear();
+	UpdateValidGrids();
 }
 
-void Board::Print()
+template <int N>
+void GameBaseN<N>::Init(Random &rng)
 {
-	PrintHSplitLine();
+	state = E_NORMAL;
+	turn = 1;
 
-	int id = 0;
-	for (int i = 0; i < BOARD_SIZE; ++i)
-	{
-		PrintVSplitLine();
-		cout << "|";
+	board.Clear();
+	UpdateValidGrids();
 
-		for (int j = 0; j < BOARD_SIZE; ++j)
-		{
-			int grid = grids[id++];
-			if (grid > 0)
-			{
-				int num = 1 << (grid);
+	RandomGenerate(rng);
+	RandomGenerate(rng);
 
-				if (num >= 100)
-					printf(" %4d |", num);
-				else
-					printf(" %3d  |", num);
-			}
-			else
-				printf("      |");
-		}
-		cout << endl;
-		PrintVSplitLine();
-		PrintHSplitLine();
-	}
+	turn = 1; // reset turn to 1
 }
 
-// line grid order: 3, 2, 1, 0
-void Board::InitLineDict()
+template <int N>
+bool GameBaseN<N>::IsGameFinish() const
 {
-	FILE *fp;
-	if (OUTPUT_LINE_DICT)
-		fopen_s(&fp, "line_dict.txt", "w");
-
-	int validIdCount, resultCount;
-	array<char, BOARD_SIZE> line, result, validId, allId;
-
-	for (int i = 0; i < LINE_DICT_SIZE; ++i)
-	{
-		// init line
-		Board::Key2Line(i, line);
-
-		// collect valid grids
-		validIdCount = 0;
-		validId.fill(0);
-
-		for (int j = 0; j < BOARD_SIZE; ++j)
-		{
-			if (line[j] > 0)
-			{
-				validId[validIdCount++] = j;
-			}
-			allId[j] = j;
-		}
-
-		// move & combine
-		resultCount = 0;
-		result.fill(0);
-
-		if (validIdCount > 0)
-			result[0] = line[validId[0]];
-
-		int v0 = -1, v1;
-
-		for (int j = 0; j < validIdCount; ++j)
-		{
-			v1 = line[validId[j]];
-
-			if (v0 == -1)
-			{
-				result[resultCount] = v1;
-				v0 = v1;
-			}
-			else if (v0 == v1)
-			{
-				result[resultCount++] = v0 + 1;
-				v0 = -1;
-			}
-			else
-			{
-				result[resultCount++] = v0;
-				result[resultCount] = v1;
-				v0 = v1;
-			}
-		}
-
-		// calc line result
-		int value = Board::Line2Key(result);
-		lineDict[i] = value;
-
-		if (OUTPUT_LINE_DICT && value != i)
-		{
-			fprintf(fp, "%6d: ", i);
-			for (int j = 0; j < BOARD_SIZE; ++j)
-			{
-				int num = line[j] > 0 ? (1 << line[j]) : 0;
-				fprintf(fp, "%6d", num);
-			}
-			fprintf(fp, " | ");
-
-			for (int j = 0; j < BOARD_SIZE; ++j)
-			{
-				int num = result[j] > 0 ? (1 << result[j]) : 0;
-				fprintf(fp, "%6d", num);
-			}
-			fprintf(fp, "\n");
-		}
-	}
-
-	if (OUTPUT_LINE_DICT)
-		fclose(fp);
-
-	Board::isLineDictReady = true;
+	return state != E_NORMAL;
 }
 
-int Board::Line2Key(const array<char, BOARD_SIZE> &line)
+template <int N>
+int GameBaseN<N>::GetSide() const
 {
-	int key = 0;
-	for (int i = BOARD_SIZE - 1; i >= 0; --i)
-	{
-		key = (key << 4) + line[i];
-	}
-	return key;
+	return (turn % 2 == 1) ? Board::E_PLAYER : Board::E_SYSTEM;
 }
 
-void Board::Key2Line(int key, array<char, BOARD_SIZE> &line)
+template <int N>
+int GameBaseN<N>::GetNextMove(Random &rng, int policy)
 {
-	for (int i = 0; i < BOARD_SIZE; ++i)
+	if (GetSide() == Board::E_PLAYER)
 	{
-		line[i] = key & 0xf;
-		key = key >> 4;
+		if (policy == E_ROLLOUT_GREEDY)
+			return GetGreedyMove();
+		if (policy == E_ROLLOUT_EPSILON_GREEDY)
+			return rng.NextFloat() < ROLLOUT_EPSILON ? GetNaiveMove(rng) : GetGreedyMove();
+		return GetNaiveMove(rng);
 	}
-}
+	else // E_SYSTEM
+	{
+		int id = rng.NextInt(validGridCount);
 
-#if USE_LINE_DICT
+		int ratio = min(validGridCount + 3, 10);
+		int value = (rng.NextInt(ratio) == 0) ? 2 : 1;
+		int action = EncodeAction(validGrids[id], value);
+		return action;
+	}
+}
 
-__declspec(noinline)
-bool Board::Move(Direction d)
+template <int N>
+int GameBaseN<N>::GetNaiveMove(Random &rng) const
 {
-	bool isChange = false;
-	array<char, BOARD_SIZE> line, allId;
-
-	for (int i = 0; i < BOARD_SIZE; ++i)
+	// naive stategy
+	int i = rng.NextInt(NAIVE_ORDER_NUM);
+	int j = 0;
+	if (moveCache != NULL)
 	{
-		for (int j = 0; j < BOARD_SIZE; ++j)
+		int legalMask = moveCache->Get(board).legalMask;
+		while (!(legalMask >> NAIVE_DIRECTION[i][j] & 1))
 		{
-			int id;
-			switch (d)
-			{
-			case Board::E_UP:
-				id = Board::Coord2Id(j, i);
-				break;
-			case Board::E_LEFT:
-				id = Board::Coord2Id(i, j);
-				break;
-			case Board::E_RIGHT:
-				id = Board::Coord2Id(i, BOARD_SIZE - j - 1);
-				break;
-			case Board::E_DOWN:
-				id = Board::Coord2Id(BOARD_SIZE - j - 1, i);
-				break;
-			}
-			allId[j] = id;
-			line[j] = grids[id];
-		}
-
-		int key = Board::Line2Key(line);
-		int value = Board::lineDict[key];
-
-		if (value != key)
-		{
-			isChange = true;
-			Board::Key2Line(value, line);
-
-			for (int j = 0; j < BOARD_SIZE; ++j)
-			{
-				grids[allId[j]] = line[j];
-				maxValue = max(maxValue, (int)line[j]);
-			}
+			++j;
 		}
-
+		return NAIVE_DIRECTION[i][j];
 	}
 
-	return isChange;
+	while (!board.Check((Board::Direction)NAIVE_DIRECTION[i][j]))
+	{
+		++j;
+	}
+	return NAIVE_DIRECTION[i][j];
 }
 
-#else
-
-__declspec(noinline)
-bool Board::Move(Direction d)
+// the legal move whose afterstate has the best heuristic score
+template <int N>
+int GameBaseN<N>::GetGreedyMove() const
 {
-	bool isChange = false;
+	int result = -1;
+	float bestScore = 0;
+	const typename MoveCacheN<N>::Entry *entry = moveCache != NULL ? &moveCache->Get(board) : NULL;
 
-	for (int i = 0; i < BOARD_SIZE; ++i)
+	for (int d = 0; d < Board::E_DIRECTION_MAX; ++d)
 	{
-		int validIdCount = 0;
-		int validId[BOARD_SIZE] = { 0 };
-		int allId[BOARD_SIZE];
-
-		for (int j = 0; j < BOARD_SIZE; ++j)
+		BoardType next = board;
+		if (entry != NULL)
 		{
-			int id;
-			switch (d)
-			{
-			case Board::E_UP:
-				id = Board::Coord2Id(j, i);
-				break;
-			case Board::E_LEFT:
-				id = Board::Coord2Id(i, j);
-				break;
-			case Board::E_RIGHT:
-				id = Board::Coord2Id(i, BOARD_SIZE - j - 1);
-				break;
-			case Board::E_DOWN:
-				id = Board::Coord2Id(BOARD_SIZE - j - 1, i);
-				break;
-			}
-
-			if (grids[id] > 0)
-			{
-				if (j != validIdCount)
-					isChange = true;
-
-				validId[validIdCount++] = id;
-			}
-			allId[j] = id;
+			if (!(entry->legalMask >> d & 1))
+				continue;
+			next.grids = entry->results[d];
 		}
-
-		int resultCount = 0;
-		int results[BOARD_SIZE] = { 0 };
-
-		if (validIdCount > 0)
-			results[0] = grids[validId[0]];
-
-		for (int k = 1; k < validIdCount; ++k)
+		else if (!next.Move((Board::Direction)d))
 		{
-			int v0 = grids[validId[k - 1]];
-			int v1 = grids[validId[k]];
-
-			if (v0 == v1)
-			{
-				results[resultCount++] = v0 + 1;
-				maxValue = max(maxValue, v0 + 1);
-				isChange = true;
-				++k;
-
-				if (k < validIdCount)
-					results[resultCount] = grids[validId[k]];
-			}
-			else
-			{
-				results[resultCount++] = v0;
-				results[resultCount] = v1;
-			}
+			continue;
 		}
 
-		for (int j = 0; j < BOARD_SIZE; ++j)
+		float score = Heuristic::EvaluateRollout(next);
+		if (result < 0 || score > bestScore)
 		{
-			grids[allId[j]] = results[j];
+			bestScore = score;
+			result = d;
 		}
 	}
-
-	return isChange;
+	return result;
 }
-#endif
 
-bool Board::Check(Direction d)
+template <int N>
+float GameBaseN<N>::CalcFastStopScore()
 {
-	for (int i = 0; i < BOARD_SIZE; ++i)
-	{
-		int lastValue = -1;
-		for (int j = 0; j < BOARD_SIZE; ++j)
-		{
-			int id;
-			switch (d)
-			{
-			case Board::E_UP:
-				id = Board::Coord2Id(j, i);
-				break;
-			case Board::E_LEFT:
-				id = Board::Coord2Id(i, j);
-				break;
-			case Board::E_RIGHT:
-				id = Board::Coord2Id(i, BOARD_SIZE - j - 1);
-				break;
-			case Board::E_DOWN:
-				id = Board::Coord2Id(BOARD_SIZE - j - 1, i);
-				break;
-			}
-
-			int value = grids[id];
-			if (value > 0)
-			{
-				if (lastValue == 0 || value == lastValue)
-					return true;
-
-			}
-			lastValue = value;
-		}
-	}
-	return false;
+	return CalcFastStopScore(validGridCount);
 }
 
-int Board::Coord2Id(int row, int col)
+template <int N>
+float GameBaseN<N>::CalcFinishScore(float ratio)
 {
-	return row * BOARD_SIZE + col;
-}
-
-void Board::Id2Coord(int id, int &row, int &col)
-{
-	row = id / BOARD_SIZE;
-	col = id % BOARD_SIZE;
-}
-
-
-///////////////////////////////////////////////////////////////////
-
-GameBase::GameBase()
-{
-	Init();
-}
-
-void GameBase::Init()
-{
-	state = E_NORMAL;
-	turn = 1;
-
-	board.Clear();
-	UpdateValidGrids();
-
-	RandomGenerate();
-	RandomGenerate();
-
-	turn = 1; // reset turn to 1
-}
-
-bool GameBase::IsGameFinish()
-{
-	return state != E_NORMAL;
-}
-
-int GameBase::GetSide()
-{
-	return (turn % 2 == 1) ? Board::E_PLAYER : Board::E_SYSTEM;
-}
-
-int GameBase::GetNextMove()
-{
-	if (GetSide() == Board::E_PLAYER)
-	{
-		// naive stategy
-		static int direction[][4] =
-		{
-			{ Board::E_LEFT, Board::E_UP, Board::E_RIGHT, Board::E_DOWN },
-			{ Board::E_UP, Board::E_LEFT, Board::E_RIGHT, Board::E_DOWN },
-			{ Board::E_RIGHT, Board::E_UP, Board::E_LEFT, Board::E_DOWN },
-			{ Board::E_UP, Board::E_RIGHT, Board::E_LEFT, Board::E_DOWN },
-			{ Board::E_RIGHT, Board::E_LEFT, Board::E_UP, Board::E_DOWN },
-			{ Board::E_LEFT, Board::E_RIGHT, Board::E_UP, Board::E_DOWN }
-		};
-
-		int i = rand() % 6;
-		int j = 0;
-		while (!board.Check((Board::Direction)direction[i][j]))
-		{
-			++j;
-		}
-		return direction[i][j];
-	}
-	else // E_SYSTEM
-	{
-		int rnd = rand();
-		int id = (rnd >> 4) % validGridCount;
-
-		int ratio = min(validGridCount + 3, 10);
-		int value = (rnd % ratio == 0) ? 2 : 1;
-		int action = GameBase::EncodeAction(id, value);
-		return action;
-	}
+	float score = ratio * 0.8f;
+	return score;
 }
 
-float GameBase::CalcFastStopScore()
+template <int N>
+float GameBaseN<N>::CalcFastStopScore(int emptyCount)
 {
 	float score1 = CalcFinishScore(1.f);
-	float score2 = clamp(validGridCount, 0, 8) / 8.f;
+	float score2 = clamp(emptyCount, 0, 8) / 8.f;
 	float score = score1 + score2 * 0.2f;
 	return score;
 }
 
-float GameBase::CalcFinishScore(float ratio)
-{
-	float score = ratio * 0.8f;
-	return score;
-}
-
-void GameBase::GetValidActions(array<uint8_t, VALID_ACTION_MAX> &result, int &count)
+template <int N>
+void GameBaseN<N>::GetValidActions(array<uint8_t, VALID_ACTION_MAX> &result, int &count) const
 {
 	count = 0;
 	if (GetSide() == Board::E_PLAYER)
 	{
+		int legalMask = GetLegalMask();
 		for (int d = 0; d < Board::E_DIRECTION_MAX; ++d)
 		{
-			if (board.Check((Board::Direction)d))
+			if (legalMask >> d & 1)
 				result[count++] = d;
 		}
 	}
 	else // E_SYSTEM
 	{
-		for (int i = 0; i < validGridCount; ++i)
+		// grid order only depends on the board, so equal boards list the same actions
+		uint64_t mask = board.EmptyMask();
+		for (int i = 0; mask != 0; ++i, mask >>= BoardType::MASK_STEP)
 		{
-			result[count++] = GameBase::EncodeAction(validGrids[i], 1);
-			result[count++] = GameBase::EncodeAction(validGrids[i], 2);
+			if (mask & 1)
+			{
+				result[count++] = EncodeAction(i, 1);
+				result[count++] = EncodeAction(i, 2);
+			}
 		}
 	}
 }
 
-string GameBase::LastAction2Str()
+template <int N>
+int GameBaseN<N>::GetLegalMask() const
+{
+	if (moveCache != NULL)
+		return moveCache->Get(board).legalMask;
+
+	int legalMask = 0;
+	for (int d = 0; d < Board::E_DIRECTION_MAX; ++d)
+	{
+		if (board.Check((Board::Direction)d))
+			legalMask |= 1 << d;
+	}
+	return legalMask;
+}
+
+template <int N>
+string GameBaseN<N>::LastAction2Str() const
+{
+	return Action2Str(GetSide(), lastMove);
+}
+
+// side is the side to move after the action
+template <int N>
+string GameBaseN<N>::Action2Str(int side, int action)
 {
-	if (GetSide() == Board::E_PLAYER) // last action is system move
+	if (side == Board::E_PLAYER) // system move
 	{
-		int id, value, row, col;
-		GameBase::DecodeAction(lastMove, id, value);
-		Board::Id2Coord(id, row, col);
+		int id, value;
+		DecodeAction(action, id, value);
+		int row = id / N, col = id % N;
 		string result(1, col + 'A');
 		result += (row + '1');
 		result += (value == 1) ? "|2" : "|4";
 		return result;
 	}
-	else // last action is player move
+	else // player move
 	{
-		return Game::Move2Str(lastMove);
+		return GameN<N>::Move2Str(action);
 	}
 }
 
-void GameBase::SetDebugBoard(const array<char, GRID_NUM> &grids)
+template <int N>
+void GameBaseN<N>::SetDebugBoard(const array<char, GRID_NUM> &grids)
 {
 	int total = 0;
 	for (int i = 0; i < GRID_NUM; ++i)
 	{
-		board.grids[i] = grids[i];
+		board.SetGrid(i, grids[i]);
 		total += pow(2, grids[i]);
 	}
 	UpdateValidGrids();
@@ -493,7 +242,8 @@ void GameBase::SetDebugBoard(const array<char, GRID_NUM> &grids)
 	turn = (total % 2 == 1) ? total : total + 1;
 }
 
-void GameBase::Move(int action)
+template <int N>
+void GameBaseN<N>::Move(int action)
 {
 	if (GetSide() == Board::E_PLAYER)
 	{
@@ -502,16 +252,28 @@ void GameBase::Move(int action)
 	else // E_SYSTEM
 	{
 		int id, value;
-		GameBase::DecodeAction(action, id, value);
+		DecodeAction(action, id, value);
 		Generate(id, value);
 	}
 	lastMove = action;
 }
 
-bool GameBase::PlayerMove(int direction)
+template <int N>
+bool GameBaseN<N>::PlayerMove(int direction)
 {
-	if (!board.Move((Board::Direction)direction))
+	if (moveCache != NULL)
+	{
+		const typename MoveCacheN<N>::Entry &entry = moveCache->Get(board);
+		if (!(entry.legalMask >> direction & 1))
+			return false;
+
+		board.grids = entry.results[direction];
+		board.maxValue = max(board.maxValue, (int)entry.maxValues[direction]);
+	}
+	else if (!board.Move((Board::Direction)direction))
+	{
 		return false;
+	}
 
 	lastMove = direction;
 	UpdateValidGrids();
@@ -526,90 +288,185 @@ bool GameBase::PlayerMove(int direction)
 	return true;
 }
 
-void GameBase::UpdateValidGrids()
+template <int N>
+void GameBaseN<N>::UpdateValidGrids()
 {
 	validGridCount = 0;
-	for (int i = 0; i < GRID_NUM; ++i)
+	uint64_t mask = board.EmptyMask();
+	for (int i = 0; mask != 0; ++i, mask >>= BoardType::MASK_STEP)
 	{
-		if (board.grids[i] == 0)
+		if (mask & 1)
 			validGrids[validGridCount++] = i;
 	}
 }
 
-void GameBase::RandomGenerate()
+template <int N>
+void GameBaseN<N>::RandomGenerate(Random &rng)
 {
-	int rnd = rand();
-	int id = (rnd >> 4) % validGridCount;
-	int value = (rnd % 10 == 0) ? 2 : 1;
-	Generate(id, value);
+	int id = rng.NextInt(validGridCount);
+	int value = (rng.NextInt(SPAWN_FOUR_RATIO) == 0) ? 2 : 1;
+	Generate(validGrids[id], value);
 }
 
-void GameBase::Generate(int id, int value)
+template <int N>
+int GameBaseN<N>::GetSpawnMove(Random &rng) const
 {
-	board.grids[validGrids[id]] = value;
-
-	swap(validGrids[id], validGrids[--validGridCount]);
+	int id = rng.NextInt(validGridCount);
+	int value = (rng.NextInt(SPAWN_FOUR_RATIO) == 0) ? 2 : 1;
+	return EncodeAction(validGrids[id], value);
+}
 
-	if (validGridCount == 0)
-		CheckLoseCondition();
+template <int N>
+float GameBaseN<N>::GetSpawnProbability(int action) const
+{
+	int id, value;
+	DecodeAction(action, id, value);
 
-	++turn;
+	float valueProbability = (value == 2) ? 1.f / SPAWN_FOUR_RATIO : 1.f - 1.f / SPAWN_FOUR_RATIO;
+	return valueProbability / max(validGridCount, 1);
 }
 
-void GameBase::CheckLoseCondition()
+template <int N>
+void GameBaseN<N>::Generate(int id, int value)
 {
-	bool hasMove = false;
-	for (int d = 0; d < Board::E_DIRECTION_MAX; ++d)
+	board.SetGrid(id, value);
+
+	for (int i = 0; i < validGridCount; ++i)
 	{
-		if (board.Check((Board::Direction)d))
+		if (validGrids[i] == id)
 		{
-			hasMove = true;
+			swap(validGrids[i], validGrids[--validGridCount]);
 			break;
 		}
 	}
 
-	if (!hasMove)
-		state = GameBase::E_LOSE;
+	if (validGridCount == 0)
+		CheckLoseCondition();
+
+	++turn;
+}
+
+template <int N>
+void GameBaseN<N>::CheckLoseCondition()
+{
+	if (GetLegalMask() == 0)
+		state = E_LOSE;
+}
+
+template <int N>
+int GameBaseN<N>::EncodeAction(int id, int value)
+{
+	return (id << ACTION_ID_SHIFT) | value;
 }
 
-int GameBase::EncodeAction(int id, int value)
+template <int N>
+void GameBaseN<N>::DecodeAction(int action, int &id, int &value)
 {
-	return (id << 4) | value;
+	id = action >> ACTION_ID_SHIFT;
+	value = action & ((1 << ACTION_ID_SHIFT) - 1);
 }
 
-void GameBase::DecodeAction(int action, int &id, int &value)
+template <int N>
+GameN<N>::GameN(uint64_t seed) : rng(seed)
 {
-	id = action >> 4;
-	value = action & 0xf;
+	Base::Init(rng);
+
+	recorder = NULL;
+	gameId = 0;
+	SetSearchInfo(0, 0, 0);
 }
 
-void Game::Print()
+template <int N>
+void GameN<N>::Print()
 {
 	cout << "\n  ===== Current Board =====" << endl;
 	board.Print();
 
-	if (state == E_WIN)
+	if (state == Base::E_WIN)
 		cout << "Congratulations! You Win!" << endl;
 
-	if (state == E_LOSE)
+	if (state == Base::E_LOSE)
 		cout << "Sorry! You Lose!" << endl;
 }
 
-bool Game::Move(int direction)
+template <int N>
+bool GameN<N>::Move(int direction)
 {
 	if (direction < 0 || direction >= Board::E_DIRECTION_MAX)
 		return false;
 
-	if (!GameBase::PlayerMove(direction))
+	auto grids = board.grids;
+	int startTurn = turn;
+	if (!Base::PlayerMove(direction))
 		return false;
 
+	auto moved = board.grids;
 	if (!IsGameFinish())
-		GameBase::RandomGenerate();
+		Base::RandomGenerate(rng);
+
+	if constexpr (N == BOARD_SIZE)
+	{
+		if (recorder == NULL)
+			return true;
+
+		GameRecord record = {};
+		record.grids = grids;
+		record.gameId = gameId;
+		record.turn = startTurn;
+		record.iterations = searchIterations;
+		record.searchTime = searchTime;
+		record.winRate = (uint16_t)(clamp(searchWinRate, 0.f, 1.f) * 65535);
+		record.move = (uint8_t)(direction | (state << 4));
+
+		// the spawned tile is the only grid that changed after the player move
+		uint64_t spawned = board.grids ^ moved;
+		if (spawned != 0)
+		{
+			int id = 0;
+			while ((spawned >> (id * 4) & 0xf) == 0)
+				++id;
+			record.spawn = (uint8_t)Base::EncodeAction(id, board.GetGrid(id));
+		}
 
+		recorder->Write(record);
+		SetSearchInfo(0, 0, 0);
+
+		// a finished game is on disk even if the process is killed later
+		if (IsGameFinish())
+			recorder->Flush();
+	}
 	return true;
 }
 
-string Game::Move2Str(int direction)
+template <int N>
+void GameN<N>::SetRecorder(RecordWriter *writer)
+{
+	recorder = (N == BOARD_SIZE) ? writer : NULL;
+	gameId = recorder != NULL ? recorder->BeginGame() : 0;
+}
+
+template <int N>
+void GameN<N>::SetSearchInfo(int iterations, float time, float winRate)
+{
+	searchIterations = iterations;
+	searchTime = time;
+	searchWinRate = winRate;
+}
+
+// continues from a given position, the turn is estimated from the tiles
+template <int N>
+void GameN<N>::SetBoard(const array<char, Base::GRID_NUM> &grids)
+{
+	board.Clear();
+	state = Base::E_NORMAL;
+	Base::SetDebugBoard(grids);
+
+	if (Base::validGridCount == 0)
+		Base::CheckLoseCondition();
+}
+
+template <int N>
+string GameN<N>::Move2Str(int direction)
 {
 	switch (direction)
 	{
@@ -624,4 +481,33 @@ string Game::Move2Str(int direction)
 	default:
 		return "";
 	}
-}
\ No newline at end of file
+}
+
+template <int N>
+float SearchEngineN<N>::CalcTimeRatio(const GameBaseN<N> &game)
+{
+	float boardRatio = clamp(6 - game.validGridCount, 1, 5) / 5.f;
+	float turnRatio = clamp((game.turn - 400.f) / 800.f, 0.f, 1.f);
+	return boardRatio * turnRatio;
+}
+
+template <int N>
+float SearchEngineN<N>::CalcSearchTime(float timeRatio)
+{
+	return SEARCH_TIME_MAX * timeRatio + SEARCH_TIME_MIN * (1 - timeRatio);
+}
+
+template class GameBaseN<3>;
+template class GameBaseN<4>;
+template class GameBaseN<5>;
+template class GameBaseN<6>;
+
+template class GameN<3>;
+template class GameN<4>;
+template class GameN<5>;
+template class GameN<6>;
+
+template class SearchEngineN<3>;
+template class SearchEngineN<4>;
+template class SearchEngineN<5>;
+template class SearchEngineN<6>;
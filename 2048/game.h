@@ -1,117 +1,151 @@
 #pragma once
-#include <iostream>
-#include <string>
-#include <vector>
-#include <array>
-#include <list>
+#include "boardn.h"
+#include "random.h"
 
-#pragma warning (disable:4244)
-#pragma warning (disable:4018)
-
-using namespace std;
-
-const int BOARD_SIZE = 4;
-const int GRID_NUM = BOARD_SIZE * BOARD_SIZE;
 const int VALID_ACTION_MAX = GRID_NUM * 2;
 const int WIN_CONDITION = 11;
-const int LINE_DICT_SIZE = 16 * 16 * 16 * 16;
-
-using std::max;
-using std::min;
 
-template<typename T>
-inline T clamp(T x, T min, T max)
-{
-	return std::max(std::min(x, max), min);
-}
+template <int N> class MoveCacheN;
+class RecordWriter;
 
-class Board
+// the enums of the games of every size
+class GameTypes
 {
 public:
-	enum Side
-	{
-		E_PLAYER,
-		E_SYSTEM,
+	enum State {
+		E_NORMAL,
+		E_WIN,
+		E_LOSE,
 	};
 
-	enum Direction
-	{
-		E_UP,
-		E_LEFT,
-		E_RIGHT,
-		E_DOWN,
-		E_DIRECTION_MAX,
+	enum RolloutPolicy {
+		E_ROLLOUT_NAIVE,
+		E_ROLLOUT_GREEDY,
+		E_ROLLOUT_EPSILON_GREEDY,
 	};
 
-	Board();
-
-	void Clear();
-	void Print();
-	bool Move(Direction d);
-	bool Check(Direction d);
-
-	array<char, GRID_NUM> grids;
-	int maxValue;
-
-	static int Coord2Id(int row, int col);
-	static void Id2Coord(int id, int &row, int &col);
-
-private:
-	static bool isLineDictReady;
-	static array<short, LINE_DICT_SIZE> lineDict;
-	static void InitLineDict();
-	static int Line2Key(const array<char, BOARD_SIZE> &line);
-	static void Key2Line(int key, array<char, BOARD_SIZE> &line);
-
-	void PrintHSplitLine();
-	void PrintVSplitLine();
+	// direction orders of the naive rollout, the first legal direction of a random order is played
+	static const int NAIVE_ORDER_NUM = 6;
+	static const int NAIVE_DIRECTION[NAIVE_ORDER_NUM][Board::E_DIRECTION_MAX];
 };
 
-class GameBase
+// the rules of an NxN game, the 4x4 game is GameBase. the members of all sizes are instantiated in game.cpp
+template <int N>
+class GameBaseN : public GameTypes
 {
 public:
-	enum State {
-		E_NORMAL,
-		E_WIN,
-		E_LOSE,
-	};
-
-	GameBase();
-	void Init();
-	bool IsGameFinish();
-	int GetSide();
-	int GetNextMove();
+	using BoardType = BoardOf<N>;
+
+	static const int GRID_NUM = N * N;
+	static const int VALID_ACTION_MAX = GRID_NUM * 2;
+	static const int WIN_CONDITION = ::WIN_CONDITION + 2 * (N - BOARD_SIZE);	// 2048 on 4x4, the goal grows with the board
+	static const int ACTION_ID_SHIFT = (N <= BOARD_SIZE) ? 4 : 2;			// a spawn action fits in a byte on every size
+
+	GameBaseN();
+	void Init(Random &rng);
+	bool IsGameFinish() const;
+	int GetSide() const;
+	int GetNextMove(Random &rng, int policy = E_ROLLOUT_NAIVE);
 	float CalcFastStopScore();
-	float CalcFinishScore(float ratio);
-	void GetValidActions(array<uint8_t, VALID_ACTION_MAX> &result, int &count);
-	string LastAction2Str();
+	static float CalcFastStopScore(int emptyCount);
+	static float CalcFinishScore(float ratio);
+	void GetValidActions(array<uint8_t, VALID_ACTION_MAX> &result, int &count) const;
+	string LastAction2Str() const;
 	void SetDebugBoard(const array<char, GRID_NUM> &grids);
 
 	void Move(int action);
 	bool PlayerMove(int direction);
 	void UpdateValidGrids();
-	void RandomGenerate();
+	void RandomGenerate(Random &rng);
 	void Generate(int id, int value);
 	void CheckLoseCondition();
+	int GetNaiveMove(Random &rng) const;
+	int GetGreedyMove() const;
+	int GetLegalMask() const;
+	int GetSpawnMove(Random &rng) const;			// spawn action drawn like RandomGenerate
+	float GetSpawnProbability(int action) const;	// chance of a spawn action in the real game
 
 	static int EncodeAction(int id, int value);
 	static void DecodeAction(int action, int &id, int &value);
+	static string Action2Str(int side, int action);
 
 	int validGridCount;
 	array<uint8_t, GRID_NUM> validGrids;
-	Board board;
+	BoardType board;
 	int state;
 	int turn;
 	int lastMove;
+	MoveCacheN<N> *moveCache;	// optional, shared by the games of one thread
 };
 
-class Game : private GameBase
+using GameBase = GameBaseN<BOARD_SIZE>;
+
+template <int N> class GameN;
+
+// common interface of the search engines, returns the direction to play
+template <int N>
+class SearchEngineN
 {
 public:
+	struct SearchStats
+	{
+		int iteration;	// rollouts for MCTS, searched nodes for Expectimax
+		float time;
+	};
+
+	SearchEngineN() : verbose(true), lastStats() {}
+	virtual ~SearchEngineN() {}
+	virtual int Search(GameN<N> *state) = 0;
+
+	void SetVerbose(bool enable) { verbose = enable; }
+	const SearchStats& GetLastStats() const { return lastStats; }
+	virtual void SetSeed(uint64_t seed) {}
+
+protected:
+	// how critical a position is, from 0 early in the game to 1 late on a crowded board
+	static float CalcTimeRatio(const GameBaseN<N> &game);
+	// the time planned for a position, shared by the engines so they search for equal times
+	static float CalcSearchTime(float timeRatio);
+
+	bool verbose;
+	SearchStats lastStats;
+};
+
+using SearchEngine = SearchEngineN<BOARD_SIZE>;
+
+template <int N>
+class GameN : private GameBaseN<N>
+{
+	using Base = GameBaseN<N>;
+	using Base::board;
+	using Base::state;
+	using Base::turn;
+
+public:
+	GameN(uint64_t seed);
+
 	int GetState() { return state; }
-	bool IsGameFinish() { return GameBase::IsGameFinish(); }
+	int GetMaxValue() { return board.maxValue; }
+	int GetTurn() { return turn; }
+	bool IsGameFinish() { return Base::IsGameFinish(); }
 
 	void Print();
 	bool Move(int direction);
+	void SetBoard(const array<char, Base::GRID_NUM> &grids);
 	static string Move2Str(int direction);
-};
\ No newline at end of file
+
+	// every move is appended to the writer, with the stats of the search that chose it.
+	// a record holds a 4x4 board, so games of other sizes are not recorded
+	void SetRecorder(RecordWriter *writer);
+	void SetSearchInfo(int iterations, float time, float winRate);
+
+private:
+	Random rng;
+
+	RecordWriter *recorder;
+	uint32_t gameId;
+	int searchIterations;
+	float searchTime, searchWinRate;
+};
+
+using Game = GameN<BOARD_SIZE>;
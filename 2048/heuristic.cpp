@@ -0,0 +1,191 @@
+#include "heuristic.h"
+#include <cmath>
+
+const float LOST_PENALTY = 200000.f;
+const float MONOTONICITY_POWER = 4.f;
+const float MONOTONICITY_WEIGHT = 47.f;
+const float SUM_POWER = 3.5f;
+const float SUM_WEIGHT = 11.f;
+const float MERGE_WEIGHT = 700.f;
+const float EMPTY_WEIGHT = 270.f;
+const float CORNER_WEIGHT = 20.f;
+const int	POWER_TABLE_SIZE = 64; // every value a grid of any board size can hold
+
+// grid values raised to the powers of the line score
+struct PowerTable
+{
+	array<float, POWER_TABLE_SIZE> sum, monotonicity;
+};
+
+static const PowerTable& GetPowerTable()
+{
+	static PowerTable table = []()
+	{
+		PowerTable result;
+		for (int i = 0; i < POWER_TABLE_SIZE; ++i)
+		{
+			result.sum[i] = powf((float)i, SUM_POWER);
+			result.monotonicity[i] = powf((float)i, MONOTONICITY_POWER);
+		}
+		return result;
+	}();
+	return table;
+}
+
+static void UnpackLine(int line, int *grids)
+{
+	for (int i = 0; i < BOARD_SIZE; ++i)
+		grids[i] = (line >> (i * 4)) & 0xf;
+}
+
+float Heuristic::Evaluate(uint64_t grids)
+{
+	return Evaluate(grids, LineTable());
+}
+
+float Heuristic::EvaluateRollout(uint64_t grids)
+{
+	return Evaluate(grids, RolloutTable());
+}
+
+float Heuristic::Evaluate(uint64_t grids, const array<float, LINE_DICT_SIZE> &table)
+{
+	uint64_t transposed = Board::Transpose(grids);
+
+	float score = 0;
+	for (int i = 0; i < BOARD_SIZE; ++i)
+	{
+		int shift = i * 16;
+		score += table[(grids >> shift) & 0xffff];
+		score += table[(transposed >> shift) & 0xffff];
+	}
+	return score;
+}
+
+template <int N, bool TABLE>
+float Heuristic::EvaluateRollout(const BoardN<N, TABLE> &board)
+{
+	float score = 0;
+	int row[N], column[N];
+	for (int i = 0; i < N; ++i)
+	{
+		for (int j = 0; j < N; ++j)
+		{
+			row[j] = board.GetGrid(i * N + j);
+			column[j] = board.GetGrid(j * N + i);
+		}
+		score += CalcLine(row, N) + CalcCorner(row, N);
+		score += CalcLine(column, N) + CalcCorner(column, N);
+	}
+	return score;
+}
+
+template float Heuristic::EvaluateRollout(const BoardN<3> &board);
+template float Heuristic::EvaluateRollout(const BoardN<5> &board);
+template float Heuristic::EvaluateRollout(const BoardN<6> &board);
+
+float Heuristic::EvaluateLine(int line)
+{
+	return LineTable()[line];
+}
+
+// the table is built on first use, function local statics are initialized thread safely
+const array<float, LINE_DICT_SIZE>& Heuristic::LineTable()
+{
+	static array<float, LINE_DICT_SIZE> table = []()
+	{
+		array<float, LINE_DICT_SIZE> result;
+		int grids[BOARD_SIZE];
+		for (int i = 0; i < LINE_DICT_SIZE; ++i)
+		{
+			UnpackLine(i, grids);
+			result[i] = CalcLine(grids, BOARD_SIZE);
+		}
+		return result;
+	}();
+	return table;
+}
+
+const array<float, LINE_DICT_SIZE>& Heuristic::RolloutTable()
+{
+	static array<float, LINE_DICT_SIZE> table = []()
+	{
+		array<float, LINE_DICT_SIZE> result;
+		int grids[BOARD_SIZE];
+		for (int i = 0; i < LINE_DICT_SIZE; ++i)
+		{
+			UnpackLine(i, grids);
+			result[i] = CalcLine(grids, BOARD_SIZE) + CalcCorner(grids, BOARD_SIZE);
+		}
+		return result;
+	}();
+	return table;
+}
+
+// rewards empty grids and pending merges, penalizes big tiles and lines that are not monotonic
+float Heuristic::CalcLine(const int *grids, int count)
+{
+	const PowerTable &power = GetPowerTable();
+
+	float sum = 0;
+	int empty = 0, merges = 0;
+	int prev = 0, counter = 0;
+
+	for (int i = 0; i < count; ++i)
+	{
+		int grid = grids[i];
+		sum += power.sum[grid];
+
+		if (grid == 0)
+		{
+			++empty;
+		}
+		else
+		{
+			if (prev == grid)
+			{
+				++counter;
+			}
+			else if (counter > 0)
+			{
+				merges += 1 + counter;
+				counter = 0;
+			}
+			prev = grid;
+		}
+	}
+	if (counter > 0)
+		merges += 1 + counter;
+
+	float monotonicityLeft = 0, monotonicityRight = 0;
+	for (int i = 1; i < count; ++i)
+	{
+		float a = power.monotonicity[grids[i - 1]];
+		float b = power.monotonicity[grids[i]];
+
+		if (grids[i - 1] > grids[i])
+			monotonicityLeft += a - b;
+		else
+			monotonicityRight += b - a;
+	}
+
+	return LOST_PENALTY + EMPTY_WEIGHT * empty + MERGE_WEIGHT * merges
+		- MONOTONICITY_WEIGHT * min(monotonicityLeft, monotonicityRight)
+		- SUM_WEIGHT * sum;
+}
+
+// anchoring the biggest tile at either end of the line keeps it out of the way of merges
+float Heuristic::CalcCorner(const int *grids, int count)
+{
+	int first = grids[0];
+	int last = grids[count - 1];
+
+	int maxGrid = 0;
+	for (int i = 0; i < count; ++i)
+		maxGrid = max(maxGrid, grids[i]);
+
+	if (maxGrid == 0 || (first != maxGrid && last != maxGrid))
+		return 0;
+
+	return CORNER_WEIGHT * GetPowerTable().sum[maxGrid];
+}
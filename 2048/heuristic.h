@@ -0,0 +1,26 @@
+#pragma once
+#include "game.h"
+
+// static board evaluation, the score of a board is the sum of the scores of its rows and columns,
+// each one read from a table indexed by the packed line
+class Heuristic
+{
+public:
+	static float Evaluate(uint64_t grids);
+	static float EvaluateLine(int line);
+
+	// cheaper to compare than to trust, also rewards the biggest tile sitting at the end of a line
+	static float EvaluateRollout(uint64_t grids);
+	static float EvaluateRollout(const Board &board) { return EvaluateRollout(board.grids); }
+
+	// boards without a line table score their rows and columns directly
+	template <int N, bool TABLE>
+	static float EvaluateRollout(const BoardN<N, TABLE> &board);
+
+private:
+	static float Evaluate(uint64_t grids, const array<float, LINE_DICT_SIZE> &table);
+	static const array<float, LINE_DICT_SIZE>& LineTable();
+	static const array<float, LINE_DICT_SIZE>& RolloutTable();
+	static float CalcLine(const int *grids, int count);
+	static float CalcCorner(const int *grids, int count);
+};
@@ -0,0 +1,118 @@
+#pragma once
+#include <array>
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+
+// a line packs 4 bits per grid with grid 0 in the lowest bits, exactly like a row of the board
+const int LINE_CHANGE_LEFT = 1;
+const int LINE_CHANGE_RIGHT = 2;
+
+template <int N>
+constexpr int ReverseLine(int line)
+{
+	int result = 0;
+	for (int i = 0; i < N; ++i)
+		result |= ((line >> (i * 4)) & 0xf) << ((N - 1 - i) * 4);
+	return result;
+}
+
+// 0xf is the largest value a grid can hold so it never merges
+template <int N>
+constexpr int MoveLineLeft(int line, int &score)
+{
+	int result = 0, count = 0, pending = 0;
+	score = 0;
+
+	for (int i = 0; i < N; ++i)
+	{
+		int grid = (line >> (i * 4)) & 0xf;
+		if (grid == 0)
+			continue;
+
+		if (pending == grid && grid < 0xf)
+		{
+			result |= (grid + 1) << (count++ * 4);
+			score += 1 << (grid + 1);
+			pending = 0;
+		}
+		else
+		{
+			if (pending != 0)
+				result |= pending << (count++ * 4);
+			pending = grid;
+		}
+	}
+
+	if (pending != 0)
+		result |= pending << (count * 4);
+	return result;
+}
+
+// move tables of a line of N grids, every table is a separate constant expression so that
+// each one stays within the compiler's evaluation limits, a table is only built if it is used
+template <int N>
+struct LineTable
+{
+	static constexpr int SIZE = 1 << (4 * N);
+	using Line = std::conditional_t<(N <= 4), uint16_t, uint32_t>;
+
+	static constexpr std::array<Line, SIZE> MakeLeft()
+	{
+		std::array<Line, SIZE> result{};
+		for (int i = 0; i < SIZE; ++i)
+		{
+			int score = 0;
+			result[i] = MoveLineLeft<N>(i, score);
+		}
+		return result;
+	}
+
+	// moving right is moving left on the reversed line
+	static constexpr std::array<Line, SIZE> MakeRight()
+	{
+		std::array<Line, SIZE> result{};
+		for (int i = 0; i < SIZE; ++i)
+			result[i] = ReverseLine<N>(left[ReverseLine<N>(i)]);
+		return result;
+	}
+
+	static constexpr std::array<uint8_t, SIZE> MakeMaxValue()
+	{
+		std::array<uint8_t, SIZE> result{};
+		for (int i = 0; i < SIZE; ++i)
+		{
+			int maxValue = 0;
+			for (int j = 0; j < N; ++j)
+				maxValue = std::max(maxValue, (i >> (j * 4)) & 0xf);
+			result[i] = maxValue;
+		}
+		return result;
+	}
+
+	static constexpr std::array<uint32_t, SIZE> MakeScore()
+	{
+		std::array<uint32_t, SIZE> result{};
+		for (int i = 0; i < SIZE; ++i)
+		{
+			int score = 0;
+			MoveLineLeft<N>(i, score);
+			result[i] = score;
+		}
+		return result;
+	}
+
+	static constexpr std::array<uint8_t, SIZE> MakeChange()
+	{
+		std::array<uint8_t, SIZE> result{};
+		for (int i = 0; i < SIZE; ++i)
+			result[i] = (left[i] != i ? LINE_CHANGE_LEFT : 0) | (right[i] != i ? LINE_CHANGE_RIGHT : 0);
+		return result;
+	}
+
+	static constexpr std::array<Line, SIZE> left = MakeLeft();
+	static constexpr std::array<Line, SIZE> right = MakeRight();
+	static constexpr std::array<uint8_t, SIZE> maxValue = MakeMaxValue();	// largest grid of the line
+	static constexpr std::array<uint32_t, SIZE> score = MakeScore();		// sum of the tiles merged by moving left
+	static constexpr std::array<uint8_t, SIZE> change = MakeChange();		// bit 0: moving left changes the line, bit 1: moving right does
+};
@@ -0,0 +1,254 @@
+#include <cmath>
+#include "logger.h"
+
+const char* LOG_FILE_FORMAT = "MCTS%d.log";
+const char* LOG_FILE_FULL = "MCTS_FULL.log";
+const char* LOG_FILE_BINARY = "MCTS_TREE.bin";
+const int	LOG_FILE_NUM = 20;
+const uint32_t SNAPSHOT_MAGIC = 0x45455254; // "TREE"
+
+// fixed size record in front of the nodes of a binary snapshot, fields are in host byte order
+struct SnapshotHeader
+{
+	uint32_t magic;
+	uint32_t kind;
+	int32_t turn;
+	float c;
+	uint64_t grids;
+	uint32_t nodeCount;
+	uint32_t size;			// 0 in files written before other board sizes
+};
+
+static_assert(sizeof(SnapshotNode) == 16, "snapshot node should stay compact");
+static_assert(sizeof(SnapshotHeader) == 32, "snapshot header should have no padding");
+
+TreeLogger::TreeLogger(bool fullBinary, int queueSize)
+{
+	this->fullBinary = fullBinary;
+	this->queueSize = max(queueSize, 1);
+	dropped = 0;
+	stop = false;
+	cleared = false;
+
+	worker = thread(&TreeLogger::Run, this);
+}
+
+TreeLogger::~TreeLogger()
+{
+	{
+		lock_guard<mutex> lock(queueMtx);
+		stop = true;
+	}
+	queueCv.notify_one();
+	worker.join();
+}
+
+bool TreeLogger::Push(TreeSnapshot &&snapshot)
+{
+	{
+		lock_guard<mutex> lock(queueMtx);
+		if ((int)queue.size() >= queueSize)
+		{
+			dropped++;
+			return false;
+		}
+		queue.push_back(move(snapshot));
+	}
+	queueCv.notify_one();
+	return true;
+}
+
+// pending snapshots are still written when the logger is stopped
+void TreeLogger::Run()
+{
+	while (1)
+	{
+		TreeSnapshot snapshot;
+		{
+			unique_lock<mutex> lock(queueMtx);
+			queueCv.wait(lock, [this]() { return stop || !queue.empty(); });
+
+			if (queue.empty())
+				return;
+
+			snapshot = move(queue.front());
+			queue.pop_front();
+		}
+
+		Write(snapshot);
+	}
+}
+
+// the files of an earlier run are cleared on the first snapshot, an engine that never logs leaves no files
+void TreeLogger::ClearFiles()
+{
+	for (int i = 0; i < LOG_FILE_NUM; ++i)
+	{
+		char logFile[20];
+		snprintf(logFile, 20, LOG_FILE_FORMAT, i + 1);
+
+		FILE *logFp = fopen(logFile, "w");
+		if (logFp != NULL)
+			fclose(logFp);
+	}
+
+	if (fullBinary)
+	{
+		FILE *logFp = fopen(LOG_FILE_BINARY, "wb");
+		if (logFp != NULL)
+			fclose(logFp);
+	}
+	cleared = true;
+}
+
+void TreeLogger::Write(const TreeSnapshot &snapshot)
+{
+	if (!cleared)
+		ClearFiles();
+
+	if (snapshot.kind == TreeSnapshot::E_FULL && fullBinary)
+	{
+		FILE *fp = fopen(LOG_FILE_BINARY, "ab");
+		if (fp == NULL)
+			return;
+
+		WriteBinary(fp, snapshot);
+		fclose(fp);
+		return;
+	}
+
+	FILE *fp;
+	if (snapshot.kind == TreeSnapshot::E_FULL)
+	{
+		fp = fopen(LOG_FILE_FULL, "w");
+	}
+	else
+	{
+		int logId = snapshot.turn / 100 + 1;
+		char logFile[20];
+		snprintf(logFile, 20, LOG_FILE_FORMAT, logId);
+		fp = fopen(logFile, "a+");
+	}
+
+	if (fp == NULL)
+		return;
+
+	WriteText(fp, snapshot);
+	fclose(fp);
+}
+
+// actions are encoded per board size
+static string Action2Str(int size, int side, int action)
+{
+	switch (size)
+	{
+	case 3: return GameBaseN<3>::Action2Str(side, action);
+	case 5: return GameBaseN<5>::Action2Str(side, action);
+	case 6: return GameBaseN<6>::Action2Str(side, action);
+	default: return GameBase::Action2Str(side, action);
+	}
+}
+
+static int MarkSubtree(const TreeSnapshot &snapshot, vector<int> &subtreeEnd, int index)
+{
+	int next = index + 1;
+	for (int i = 0; i < snapshot.nodes[index].childCount; ++i)
+		next = MarkSubtree(snapshot, subtreeEnd, next);
+
+	subtreeEnd[index] = next;
+	return next;
+}
+
+void TreeLogger::WriteText(FILE *fp, const TreeSnapshot &snapshot)
+{
+	if (snapshot.nodes.empty())
+		return;
+
+	vector<int> subtreeEnd(snapshot.nodes.size());
+	MarkSubtree(snapshot, subtreeEnd, 0);
+
+	const SnapshotNode &root = snapshot.nodes[0];
+	if (snapshot.kind == TreeSnapshot::E_TOP_K && snapshot.size == BOARD_SIZE)
+	{
+		Board board;
+		board.grids = snapshot.grids;
+		board.Print(fp);
+		fprintf(fp, "===============================PrintTree=============================\n");
+	}
+	else
+	{
+		fprintf(fp, "===============================PrintFullTree=============================\n");
+	}
+
+	fprintf(fp, "visit: %d, value: %.1f, children: %d\n", root.visit, root.value, root.totalChildren);
+	WriteTextNode(fp, snapshot, subtreeEnd, 0, 1);
+	fprintf(fp, "================================TreeEnd============================\n\n");
+}
+
+int TreeLogger::WriteTextNode(FILE *fp, const TreeSnapshot &snapshot, const vector<int> &subtreeEnd, int index, int level)
+{
+	const SnapshotNode &node = snapshot.nodes[index];
+
+	// a full snapshot keeps the arena order, so the children are sorted here instead of in the search thread
+	vector<int> children;
+	int child = index + 1;
+	for (int i = 0; i < node.childCount; ++i)
+	{
+		children.push_back(child);
+		child = subtreeEnd[child];
+	}
+
+	stable_sort(children.begin(), children.end(), [&snapshot](int a, int b)
+	{
+		return snapshot.nodes[a].visit > snapshot.nodes[b].visit;
+	});
+
+	float expandFactorParent_c = sqrtf(logf((float)node.visit)) * snapshot.c;
+	for (auto id : children)
+	{
+		const SnapshotNode &childNode = snapshot.nodes[id];
+
+		fprintf(fp, "%d", level);
+		for (int j = 0; j < level; ++j)
+			fprintf(fp, "   ");
+
+		float score = childNode.winRate + expandFactorParent_c / sqrtf((float)max(childNode.visit, 1));
+		fprintf(fp, "visit: %d, value: %.1f, raw_score: %.6f, score: %.6f, children: %d, move: %s\n", childNode.visit, childNode.value, childNode.winRate, score, childNode.totalChildren, Action2Str(snapshot.size, childNode.side, childNode.action).c_str());
+		WriteTextNode(fp, snapshot, subtreeEnd, id, level + 1);
+	}
+
+	return subtreeEnd[index];
+}
+
+bool TreeLogger::WriteBinary(FILE *fp, const TreeSnapshot &snapshot)
+{
+	SnapshotHeader header;
+	header.magic = SNAPSHOT_MAGIC;
+	header.kind = snapshot.kind;
+	header.turn = snapshot.turn;
+	header.c = snapshot.c;
+	header.grids = snapshot.grids;
+	header.nodeCount = (uint32_t)snapshot.nodes.size();
+	header.size = snapshot.size;
+
+	if (fwrite(&header, sizeof(header), 1, fp) != 1)
+		return false;
+
+	return fwrite(snapshot.nodes.data(), sizeof(SnapshotNode), snapshot.nodes.size(), fp) == snapshot.nodes.size();
+}
+
+bool TreeLogger::ReadBinary(FILE *fp, TreeSnapshot &snapshot)
+{
+	SnapshotHeader header;
+	if (fread(&header, sizeof(header), 1, fp) != 1 || header.magic != SNAPSHOT_MAGIC)
+		return false;
+
+	snapshot.kind = header.kind;
+	snapshot.turn = header.turn;
+	snapshot.c = header.c;
+	snapshot.size = header.size != 0 ? header.size : BOARD_SIZE;
+	snapshot.grids = header.grids;
+	snapshot.nodes.resize(header.nodeCount);
+
+	return fread(snapshot.nodes.data(), sizeof(SnapshotNode), header.nodeCount, fp) == header.nodeCount;
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include "game.h"
+
+const int LOG_QUEUE_SIZE = 8;
+
+// a node of a tree snapshot, nodes are stored in preorder and the children follow their parent
+struct SnapshotNode
+{
+	int32_t visit;
+	float value;
+	float winRate;
+	uint8_t action;
+	uint8_t side;			// side to move after the action
+	uint8_t childCount;		// children stored in the snapshot
+	uint8_t totalChildren;	// children in the tree, more than childCount for a top-K snapshot
+};
+
+struct TreeSnapshot
+{
+	enum Kind
+	{
+		E_TOP_K,
+		E_FULL,
+	};
+
+	int kind;
+	int turn;
+	int size;				// board size, grids only holds the board of a 4x4 game
+	float c;				// exploration constant used to recompute the UCB scores
+	uint64_t grids;
+	vector<SnapshotNode> nodes;
+};
+
+// writes tree snapshots from a background thread, so the search never waits for the disk
+class TreeLogger
+{
+public:
+	enum Level
+	{
+		E_LOG_OFF,
+		E_LOG_SUMMARY,
+		E_LOG_TOP_K,
+		E_LOG_FULL,
+	};
+
+	TreeLogger(bool fullBinary, int queueSize = LOG_QUEUE_SIZE);
+	~TreeLogger();
+
+	// never blocks, the snapshot is dropped if the queue is full
+	bool Push(TreeSnapshot &&snapshot);
+	int GetDropped() const { return dropped; }
+
+	static void WriteText(FILE *fp, const TreeSnapshot &snapshot);
+	static bool WriteBinary(FILE *fp, const TreeSnapshot &snapshot);
+	static bool ReadBinary(FILE *fp, TreeSnapshot &snapshot);
+
+private:
+	void Run();
+	void ClearFiles();
+	void Write(const TreeSnapshot &snapshot);
+	static int WriteTextNode(FILE *fp, const TreeSnapshot &snapshot, const vector<int> &subtreeEnd, int index, int level);
+
+	bool fullBinary;
+	int queueSize;
+	atomic<int> dropped;
+
+	deque<TreeSnapshot> queue;
+	mutex queueMtx;
+	condition_variable queueCv;
+	bool stop;
+	bool cleared; // only touched by the worker thread
+	thread worker;
+};
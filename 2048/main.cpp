@@ -1,30 +1,53 @@
 #include "game.h"
 #include "mcts.h"
+#include "expectimax.h"
+#include "ntuple.h"
+#include "record.h"
 #include <ctime>
 
+const char* NTUPLE_FILE = "ntuple.bin";
+const char* RECORD_FILE = "GAME_RECORD.bin";
+
 int main()
 {
-	srand((unsigned)time(NULL));
+	uint64_t seed = (uint64_t)time(NULL);
 
-	MCTS ai;
 	bool useAI = true;
+	bool useExpectimax = false;
+	bool useDebugBoard = false;
+
+	// rollouts are replaced by the n-tuple network if trained weights are found
+	NTuple network;
+	MCTS mcts;
+	if (network.Load(NTUPLE_FILE))
+		mcts.SetEvaluator(&network);
 
-	Game g;
+	Expectimax expectimax;
+	SearchEngine *ai = useExpectimax ? (SearchEngine*)&expectimax : (SearchEngine*)&mcts;
+	ai->SetSeed(seed);
+
+	Game g(seed);
 	string input;
 	int move;
 
+	// every move is appended to the record file
+	RecordWriter recorder;
+	if (recorder.Open(RECORD_FILE))
+		g.SetRecorder(&recorder);
+
 	array<char, GRID_NUM> grids = { 1, 7, 10, 9,
 								    4,  5, 6, 1,
 								    1,  3, 2, 5,
 								    0,  3, 1, 3 };
-	//((GameBase*)&g)->SetDebugBoard(grids);
+	if (useDebugBoard)
+		((GameBase*)&g)->SetDebugBoard(grids);
 
 	g.Print();
 	while (!g.IsGameFinish())
 	{
 		if (useAI)
 		{
-			move = ai.Search(&g);
+			move = ai->Search(&g);
 		}
 		else
 		{
@@ -1,17 +1,36 @@
 #include <fstream>
-#include <thread>
-#include <mutex>
+#include <chrono>
 #include <cmath>
 #include <cstdlib>
+#include <algorithm>
 #include "mcts.h"
 
-const char* LOG_FILE_FORMAT = "MCTS%d.log";
-const char* LOG_FILE_FULL = "MCTS_FULL.log";
 const float Cp = 1.0f;
-const float SEARCH_TIME_MIN = 0.05f;
-const float SEARCH_TIME_MAX = 0.2f;
 const int	EXPAND_THRESHOLD = 1;
+const int	SCHEDULER_SLICE = 32;			// iterations of a task on a shared scheduler before it is queued again
 const bool	ENABLE_MULTI_THREAD = true;
+const bool	ENABLE_LOCK_FREE = true;
+const bool	ENABLE_TREE_REUSE = true;
+const bool	ENABLE_TRANS_TABLE = true;
+const bool	ENABLE_MOVE_CACHE = true;
+const int	VIRTUAL_LOSS = 1;
+const int	ROLLOUT_POLICY = GameBase::E_ROLLOUT_NAIVE;
+const int	ROLLOUT_BATCH = 8;				// naive rollouts of a leaf played together by BatchRollout, 1 plays them one by one
+const int	LEAF_ROLLOUT_STEPS = 0;			// random moves played before the evaluator scores a leaf
+const float	LEAF_VALUE_SCALE = 2000.f;		// evaluator difference to the root that counts as a clear win
+
+const bool	ENABLE_EARLY_STOP = true;		// stop once the move is settled, see CanStopEarly
+const int	EARLY_STOP_INTERVAL = 64;		// iterations of thread 0 between checks
+const float	EARLY_STOP_MIN_RATIO = 0.2f;	// part of the planned time searched before stopping early
+const float	EARLY_STOP_Z = 2.f;				// width of the confidence intervals in standard deviations
+const bool	ENABLE_TIME_BANK = true;		// time saved by early stops is spent on critical positions
+const float	TIME_BANK_MAX = 0.4f;
+const float	TIME_BANK_SPEND = 0.5f;			// part of the bank a position with time ratio 1 may spend
+
+const bool	ENABLE_CHANCE_SAMPLING = true;	// spawn nodes sample their children instead of expanding every spawn
+const int	CHANCE_CHILD_MAX = 8;
+const float	WIDENING_C = 1.f;				// a spawn node may have WIDENING_C * visit^WIDENING_ALPHA children
+const float	WIDENING_ALPHA = 0.5f;
 
 const int	FAST_STOP_ESTIMATE_COUNT = 4;
 const int	FAST_STOP_STEPS_MAX = 400;
@@ -20,142 +39,583 @@ const int	FAST_STOP_STEPS_MIN = 100;
 const bool	ENABLE_TRY_MORE_NODE = false;
 const int	TRY_MORE_NODE_THRESHOLD = 1000;
 
-TreeNode::TreeNode(TreeNode *p)
+const int	LOG_LEVEL = TreeLogger::E_LOG_TOP_K;
+const int	LOG_TOP_K = 4;
+const bool	LOG_FULL_BINARY = true;
+const int	SNAPSHOT_NODE_MAX = 1 << 20;
+const bool	ENABLE_STATS_LOG = true;
+const char* STATS_FILE = "MCTS_STATS.jsonl";
+
+const int	NO_CHILD = -1;
+const int	ARENA_FULL = -2;
+const int	NO_ACTION = 0xff;				// a claimed slot whose action is not known yet
+
+template <class GameType>
+void TreeNode::Init(int p, int a, const GameType &game, Random &rng)
 {
-	visit = 0;
-	value = 0;
+	array<uint8_t, GameType::VALID_ACTION_MAX> actions;
+	int count;
+	game.GetValidActions(actions, count);
+
+	// a spawn node only keeps the sampled spawns, so it doesn't need a slot for every one
+	if (ENABLE_CHANCE_SAMPLING && game.GetSide() == Board::E_SYSTEM)
+		count = min(count, CHANCE_CHILD_MAX);
+
 	winRate = 0;
 	expandFactor = 0;
-	validActionCount = 0;
-	gridLevel = 0;
-	game = NULL;
+	visit = 0;
+	virtualLoss = 0;
+	value = 0;
+	firstChild = NO_CHILD;
+	validActionCount = count;
+	link = NO_CHILD;
 	parent = p;
+	action = a;
+	side = game.GetSide();
+	actionCount = count;
+	actionOffset = count > 0 ? rng.NextInt(count) : 0;
 }
 
-FILE *fp;
+void TreeNode::InitLink(int p, int a, int l)
+{
+	link = l;
+	parent = p;
+	action = a;
+}
 
-MCTS::MCTS(int mode)
+void SearchCounters::Clear()
+{
+	selections = 0;
+	expansions = 0;
+	links = 0;
+	rollouts = 0;
+	rolloutSteps = 0;
+	fastStops = 0;
+	fastStopSteps = 0;
+	lockWaitNs = 0;
+	moveCacheLookups = 0;
+	moveCacheHits = 0;
+	maxDepth = 0;
+}
+
+void SearchCounters::Merge(const SearchCounters &other)
+{
+	selections += other.selections;
+	expansions += other.expansions;
+	links += other.links;
+	rollouts += other.rollouts;
+	rolloutSteps += other.rolloutSteps;
+	fastStops += other.fastStops;
+	fastStopSteps += other.fastStopSteps;
+	lockWaitNs += other.lockWaitNs;
+	moveCacheLookups += other.moveCacheLookups;
+	moveCacheHits += other.moveCacheHits;
+	maxDepth = max(maxDepth, other.maxDepth);
+}
+
+// every engine of a process writes to one stats file, it is truncated once when the first engine opens it
+static mutex statsMtx;
+static atomic<int> engineCount(0);
+
+static FILE* OpenStatsFile()
+{
+	static FILE *fp = fopen(STATS_FILE, "w");
+	return fp;
+}
+
+static void AtomicAdd(atomic<float> &target, float delta)
+{
+	float current = target.load(memory_order_relaxed);
+	while (!target.compare_exchange_weak(current, current + delta, memory_order_relaxed));
+}
+
+template <int N>
+MCTSN<N>::MCTSN(int mode, int threadNum, int transTableMB, SearchScheduler *scheduler) : transTable(ENABLE_TRANS_TABLE ? transTableMB : 0), logger(LOG_FULL_BINARY)
 {
 	this->mode = mode;
+	logLevel = LOG_LEVEL;
+	rolloutPolicy = ROLLOUT_POLICY;
+	evaluator = NULL;
+	leafBaseline = 0;
+	timeBank = 0;
+	lastTurn = 0;
+	fixedSearchTime = 0;
+	lastEarlyStop = false;
 
 	root = NULL;
+	nodes = new TreeNode[NODE_ARENA_SIZE];
+	spareNodes = new TreeNode[NODE_ARENA_SIZE];
+	nodeCount = 0;
+
+	if (threadNum <= 0)
+		threadNum = ENABLE_MULTI_THREAD ? thread::hardware_concurrency() : 1;
+	this->threadNum = clamp(threadNum, 1, THREAD_NUM_MAX);
+	this->scheduler = scheduler;
+
+	searchGeneration = 0;
+	runningWorkers = 0;
+	stopWorkers = false;
+
+	// with a shared scheduler the thread count only limits how many slices of a search run at once
+	for (int i = 0; scheduler == NULL && i < this->threadNum; ++i)
+		workers.push_back(thread(WorkerThread, i, this));
+
+	lastCounters.Clear();
+	engineId = engineCount++;
+	statsFp = ENABLE_STATS_LOG ? OpenStatsFile() : NULL;
+}
 
-	// clear log file
-	for (int i = 0; i < 20; ++i)
+template <int N>
+MCTSN<N>::~MCTSN()
+{
 	{
-		char logFile[20];
-		sprintf_s(logFile, 20, LOG_FILE_FORMAT, i + 1);
+		lock_guard<mutex> lock(workerMtx);
+		stopWorkers = true;
+	}
+	workerCv.notify_all();
+
+	for (auto &worker : workers)
+		worker.join();
+
+	delete[] nodes;
+	delete[] spareNodes;
 
-		fopen_s(&fp, logFile, "w");
-		fclose(fp);
+	if (statsFp != NULL)
+	{
+		lock_guard<mutex> lock(statsMtx);
+		fflush(statsFp);
 	}
 }
 
-MCTS::~MCTS()
+mutex mtx;
+
+static void LockTimed(mutex &m, SearchCounters &counters)
 {
-	ClearPool();
+	auto start = chrono::steady_clock::now();
+	m.lock();
+	counters.lockWaitNs += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
 }
 
-mutex mtx;
-
-void MCTS::SearchThread(int id, int seed, MCTS *mcts, clock_t startTime, float searchTime)
+template <int N>
+void MCTSN<N>::WorkerThread(int id, MCTSN *mcts)
 {
-	srand(seed); // need to call srand for each thread
-	float elapsedTime = 0;
+	int generation = 0;
 
 	while (1)
 	{
-		mtx.lock();
-		TreeNode *node = mcts->TreePolicy(mcts->root);
-		mtx.unlock();
+		{
+			unique_lock<mutex> lock(mcts->workerMtx);
+			mcts->workerCv.wait(lock, [&]() { return mcts->stopWorkers || mcts->searchGeneration != generation; });
 
-		float value = mcts->DefaultPolicy(node, id);
+			if (mcts->stopWorkers)
+				return;
 
-		mtx.lock();
-		mcts->UpdateValue(node, value);
-		mtx.unlock();
+			generation = mcts->searchGeneration;
+		}
+
+		SearchThread(id, mcts->workerSeeds[id], mcts, mcts->searchDeadline);
 
-		elapsedTime = float(clock() - startTime) / 1000;
-		if (elapsedTime > searchTime)
 		{
-			mtx.lock();
-			TreeNode *mostVisit = *max_element(mcts->root->children.begin(), mcts->root->children.end(), [](const TreeNode *a, const TreeNode *b)
-			{
-				return a->visit < b->visit;
-			});
+			lock_guard<mutex> lock(mcts->workerMtx);
+			if (--mcts->runningWorkers == 0)
+				mcts->doneCv.notify_one();
+		}
+	}
+}
+
+template <int N>
+void MCTSN<N>::SearchThread(int id, uint64_t seed, MCTSN *mcts, chrono::steady_clock::time_point deadline)
+{
+	mcts->StartSearch(id, seed);
+	while (mcts->RunIterations(id, INT32_MAX, deadline));
+}
+
+template <int N>
+void MCTSN<N>::StartSearch(int id, uint64_t seed)
+{
+	Context &context = contexts[id];
+	context.rng.Seed(seed);
+	context.counters.Clear();
+	context.moveCache.ResetStats();
+	context.iteration = 0;
+
+	// a private tree is grown from a root of its own
+	if (mode == E_ROOT_PARALLEL)
+	{
+		context.root = NewTreeNode(NO_CHILD, 0, rootGame, id);
+		transTable.Store(TranspositionTable::MakeKey(rootGame), int(context.root - nodes), context.tableSlice);
+	}
+	else
+	{
+		context.root = root;
+	}
+	context.startVisit = context.root->visit;
+}
+
+// runs up to count iterations, returns false once the search is over for this context
+template <int N>
+bool MCTSN<N>::RunIterations(int id, int count, chrono::steady_clock::time_point deadline)
+{
+	Context &context = contexts[id];
+	TreeNode *searchRoot = context.root;
 
-			TreeNode *bestScore = mcts->BestChild(mcts->root, 0);
+	// naive rollouts rarely see a board twice and only try one or two moves, a cache miss would cost all four
+	bool useMoveCache = ENABLE_MOVE_CACHE && rolloutPolicy != GameBase::E_ROLLOUT_NAIVE;
+	bool useLock = !ENABLE_LOCK_FREE && mode == E_TREE_PARALLEL;
+
+	for (int i = 0; i < count; ++i)
+	{
+		context.game = rootGame;
+		context.game.moveCache = useMoveCache ? &context.moveCache : NULL;
+
+		if (useLock)
+			LockTimed(mtx, context.counters);
+		TreeNode *node = TreePolicy(searchRoot, id);
+		if (useLock)
 			mtx.unlock();
-			
-			break;
-			//if (mostVisit == bestScore)
-			//	break;
+
+		context.counters.maxDepth = max(context.counters.maxDepth, (int)context.path.size() - 1);
+
+		int rollouts = 1;
+		float value = DefaultPolicy(node, id, rollouts);
+
+		if (useLock)
+			LockTimed(mtx, context.counters);
+		UpdateValue(context.path, value, rollouts);
+		if (useLock)
+			mtx.unlock();
+
+		// thread 0 decides for all threads whether the move is settled, in root-parallel search from its own tree
+		if (ENABLE_EARLY_STOP && id == 0 && ++context.iteration % EARLY_STOP_INTERVAL == 0 && CanStopEarly(searchRoot))
+			stopSearch.store(true, memory_order_relaxed);
+
+		// a search ends with at least one root child, even if its slices started late.
+		// a root without a legal move or without room in the arena never gets one, so it ends at once
+		bool rootStuck = searchRoot->actionCount == 0 || searchRoot->firstChild == ARENA_FULL;
+		if (rootStuck || ((stopSearch.load(memory_order_relaxed) || chrono::steady_clock::now() > deadline) && searchRoot->firstChild >= 0))
+		{
+			context.counters.moveCacheLookups = context.moveCache.GetLookups();
+			context.counters.moveCacheHits = context.moveCache.GetHits();
+			return false;
 		}
 	}
+	return true;
 }
 
-int MCTS::Search(Game *state)
+template <int N>
+int MCTSN<N>::Search(Game *state)
 {
-	fastStopSteps = 0;
-	fastStopCount = 0;
+	transTable.ResetStats();
 
-	root = NewTreeNode(NULL);
-	*(root->game) = *((GameBase*)state);
-	root->game->GetValidActions(root->validActions, root->validActionCount);
+	GameBase *game = (GameBase*)state;
+	int thread_num = threadNum;
 
-	float boardRatio = clamp(6 - root->game->validGridCount, 1, 5) / 5.f;
-	float turnRatio = clamp((root->game->turn - 400.f) / 800.f, 0.f, 1.f);
-	float timeRatio = boardRatio * turnRatio;
-	float searchTime = SEARCH_TIME_MAX * timeRatio + SEARCH_TIME_MIN * (1 - timeRatio);
+	// private trees are not reused, the main root only collects their merged statistics
+	if (mode == E_ROOT_PARALLEL || !ENABLE_TREE_REUSE || !ReuseTree(*game))
+	{
+		ClearNodes();
+		rootGame = *game;
+		root = NewTreeNode(NO_CHILD, 0, rootGame);
+		if (mode != E_ROOT_PARALLEL)
+			transTable.Store(TranspositionTable::MakeKey(rootGame), 0);
+	}
+	SplitArena(thread_num);
+	int reusedVisit = root->visit;
 
-	clock_t startTime = clock();
+	float timeRatio = CalcTimeRatio(rootGame);
+	searchTime = CalcSearchTime(timeRatio);
 
-	thread threads[THREAD_NUM_MAX];
-	int thread_num = ENABLE_MULTI_THREAD ? thread::hardware_concurrency() : 1;
+	// a new game starts with an empty bank, critical positions take a share of the time saved before
+	if (game->turn < lastTurn)
+		timeBank = 0;
+	lastTurn = game->turn;
+
+	bool useBank = ENABLE_TIME_BANK && fixedSearchTime <= 0;
+	float bankSpend = useBank ? timeBank * TIME_BANK_SPEND * timeRatio : 0;
+	searchTime += bankSpend;
+	timeBank -= bankSpend;
+
+	// a caller with its own budget replaces the plan and leaves the bank untouched
+	if (fixedSearchTime > 0)
+		searchTime = fixedSearchTime;
 
 	for (int i = 0; i < thread_num; ++i)
-		threads[i] = thread(SearchThread, i, rand(), this, startTime, searchTime);
+		workerSeeds[i] = rng.Next();
+
+	if (evaluator != NULL)
+		leafBaseline = EvaluateLeaf(rootGame);
+
+	// wall clock, the time budget is shared by all threads
+	auto startTime = chrono::steady_clock::now();
 
+	// wake up the workers with the new root and wait until all of them run out of time
+	{
+		unique_lock<mutex> lock(workerMtx);
+		searchDeadline = startTime + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<float>(searchTime));
+		searchStart = startTime;
+		stopSearch = false;
+		runningWorkers = thread_num;
+
+		if (scheduler == NULL)
+		{
+			++searchGeneration;
+			workerCv.notify_all();
+		}
+		else
+		{
+			for (int i = 0; i < thread_num; ++i)
+				contexts[i].started = false;
+			for (int i = 0; i < thread_num; ++i)
+				scheduler->Submit(SearchScheduler::Task{ [this, i]() { return RunSlice(i); }, searchDeadline });
+		}
+
+		doneCv.wait(lock, [this]() { return runningWorkers == 0; });
+	}
+
+	float elapsedTime = chrono::duration<float>(chrono::steady_clock::now() - startTime).count();
+	lastEarlyStop = stopSearch;
+
+	if (useBank)
+		timeBank = min(timeBank + max(searchTime - elapsedTime, 0.f), TIME_BANK_MAX);
+
+	if (mode == E_ROOT_PARALLEL)
+		MergeRoots(thread_num);
+
+	lastStats.iteration = root->visit - reusedVisit;
+	lastStats.time = elapsedTime;
+
+	lastCounters.Clear();
 	for (int i = 0; i < thread_num; ++i)
-		threads[i].join();
+		lastCounters.Merge(contexts[i].counters);
 
+	// a root without children has no legal move or no room in the arena, the greedy move is played then
 	TreeNode *best = BestChild(root, 0);
-	int move = best->game->lastMove;
+	if (best == NULL)
+	{
+		state->SetSearchInfo(lastStats.iteration, elapsedTime, 0);
+		return rootGame.GetGreedyMove();
+	}
 
-	maxDepth = 0;
-	PrintTree(root);
-	PrintFullTree(root);
-	printf("plan: %.2f, time: %.2f, iteration: %d, depth: %d, win: %.2f%% (%d/%d)\n", searchTime, float(clock() - startTime) / 1000, root->visit, maxDepth, best->value * 100 / best->visit, (int)best->value, best->visit);
-	printf("fast stop count: %d, average stop steps: %d\n", fastStopCount, fastStopSteps / (fastStopCount + 1));
+	int move = best->action;
+	best = Resolve(best);
+
+	// kept by the game for its record of the move
+	float winRate = best->value / max((int)best->visit, 1);
+	state->SetSearchInfo(lastStats.iteration, elapsedTime, winRate);
+
+	// telemetry is written whether or not the search prints
+	LogStats(elapsedTime, reusedVisit, winRate);
 
-	ClearNodes(root);
+	if (!verbose || logLevel == TreeLogger::E_LOG_OFF)
+		return move;
+
+	// the tree is copied into snapshots, formatting and file io happen in the logger thread
+	if (logLevel >= TreeLogger::E_LOG_TOP_K)
+		LogTree(TreeSnapshot::E_TOP_K, LOG_TOP_K);
+	if (logLevel >= TreeLogger::E_LOG_FULL)
+		LogTree(TreeSnapshot::E_FULL, 0);
+
+	printf("plan: %.2f, time: %.2f, iteration: %d, reused: %d, depth: %d, win: %.2f%% (%d/%d)\n", searchTime, elapsedTime, root->visit - reusedVisit, reusedVisit, lastCounters.maxDepth, best->value * 100 / best->visit, (int)best->value, (int)best->visit);
+	printf("threads: %d, %s, lock free: %d, iteration/s: %.0f, nodes: %d\n", thread_num, mode == E_ROOT_PARALLEL ? "root parallel" : "tree parallel", ENABLE_LOCK_FREE, (root->visit - reusedVisit) / max(elapsedTime, 1e-6f), GetNodeCount());
+	printf("fast stop count: %d, average stop steps: %d\n", (int)lastCounters.fastStops, (int)(lastCounters.fastStopSteps / (lastCounters.fastStops + 1)));
+	if (lastEarlyStop || timeBank > 0)
+		printf("early stop: %d, time bank: %.3f\n", lastEarlyStop, timeBank);
+	if (lastCounters.moveCacheLookups > 0)
+		printf("move cache lookup: %lld, hit: %.2f%%\n", (long long)lastCounters.moveCacheLookups, lastCounters.moveCacheHits * 100.f / max(lastCounters.moveCacheLookups, (int64_t)1));
+	transTable.PrintStats();
+	if (logger.GetDropped() > 0)
+		printf("log snapshots dropped: %d\n", logger.GetDropped());
 
 	return move;
 }
 
-TreeNode* MCTS::TreePolicy(TreeNode *node)
+// find the grandchild of the last root that reached the current state (player move + system move),
+// then move its subtree to the front of the spare arena, the rest of the old tree is dropped
+template <int N>
+bool MCTSN<N>::ReuseTree(const GameBase &game)
+{
+	if (root == NULL)
+		return false;
+
+	for (auto child : SortedChildren(root))
+	{
+		GameBase childGame = rootGame;
+		childGame.Move(child->action);
+
+		for (auto grandChild : SortedChildren(Resolve(child)))
+		{
+			GameBase grandChildGame = childGame;
+			grandChildGame.Move(grandChild->action);
+
+			if (grandChildGame.board.grids != game.board.grids || grandChildGame.turn != game.turn)
+				continue;
+
+			// the subtree is a DAG, every node is copied once and later references become links
+			unordered_map<int, int> copied;
+			int count = 1;
+
+			transTable.Clear();
+			CopySubtree(Resolve(grandChild), grandChildGame, 0, NO_CHILD, 0, count, copied);
+			swap(nodes, spareNodes);
+			nodeCount = count;
+
+			root = &nodes[0];
+			rootGame = grandChildGame;
+			return true;
+		}
+	}
+	return false;
+}
+
+template <int N>
+void MCTSN<N>::CopySubtree(const TreeNode *node, const GameBase &game, int id, int parent, int action, int &count, unordered_map<int, int> &copied)
 {
-	while (!node->game->IsGameFinish())
+	copied[int(node - nodes)] = id;
+	transTable.Store(TranspositionTable::MakeKey(game), id);
+
+	TreeNode &target = spareNodes[id];
+	target.winRate = node->winRate.load();
+	target.expandFactor = node->expandFactor.load();
+	target.visit = node->visit.load();
+	target.virtualLoss = 0;
+	target.value = node->value.load();
+	target.validActionCount = node->validActionCount.load();
+	target.ready = true;
+	target.link = NO_CHILD;
+	target.parent = parent;
+	target.action = action;
+	target.side = node->side;
+	target.actionCount = node->actionCount;
+	target.actionOffset = node->actionOffset;
+
+	// a node that found the old arena full gets its actions back, the new arena has room for its children
+	int first = node->firstChild;
+	if (first < 0)
+	{
+		target.firstChild = NO_CHILD;
+		target.validActionCount = node->actionCount;
+		return;
+	}
+
+	int targetFirst = count;
+	count += node->actionCount;
+	target.firstChild = targetFirst;
+
+	int childCount = node->actionCount - node->validActionCount;
+	for (int i = 0; i < node->actionCount; ++i)
+	{
+		TreeNode *slot = &nodes[first + i];
+		if (i >= childCount || !slot->ready)
+		{
+			spareNodes[targetFirst + i].ready = false;
+			spareNodes[targetFirst + i].pendingAction = NO_ACTION;
+			continue;
+		}
+
+		TreeNode *child = Resolve(slot);
+		auto it = copied.find(int(child - nodes));
+		if (it != copied.end())
+		{
+			spareNodes[targetFirst + i].InitLink(id, slot->action, it->second);
+			spareNodes[targetFirst + i].ready = true;
+			continue;
+		}
+
+		GameBase childGame = game;
+		childGame.Move(slot->action);
+		CopySubtree(child, childGame, targetFirst + i, id, slot->action, count, copied);
+	}
+}
+
+// one task of a search on a shared scheduler, the context is prepared by the first slice
+template <int N>
+bool MCTSN<N>::RunSlice(int id)
+{
+	Context &context = contexts[id];
+	if (!context.started)
+	{
+		StartSearch(id, workerSeeds[id]);
+		context.started = true;
+	}
+
+	// a slice that starts after the search ended only signs off
+	bool ended = (stopSearch.load(memory_order_relaxed) || chrono::steady_clock::now() > searchDeadline) && context.root->firstChild >= 0;
+	if (!ended && RunIterations(id, SCHEDULER_SLICE, searchDeadline))
+		return true;
+
+	lock_guard<mutex> lock(workerMtx);
+	if (--runningWorkers == 0)
+		doneCv.notify_one();
+	return false;
+}
+
+// the selected path is recorded for UpdateValue, since a linked node has several parents
+template <int N>
+TreeNode* MCTSN<N>::TreePolicy(TreeNode *node, int id)
+{
+	GameBase &game = contexts[id].game;
+	vector<TreeNode*> &path = contexts[id].path;
+
+	path.clear();
+	path.push_back(node);
+	AddVirtualLoss(node);
+
+	while (!game.IsGameFinish())
 	{
 		if (node->visit < EXPAND_THRESHOLD)
 			return node;
 
+		if (ENABLE_CHANCE_SAMPLING && node->side == Board::E_SYSTEM)
+		{
+			bool expanded = false;
+			TreeNode *child = ChanceChild(node, id, expanded);
+			if (child == NULL)
+				return node;
+
+			if (!expanded)
+			{
+				game.Move(child->action);
+				contexts[id].counters.selections++;
+			}
+			node = Resolve(child);
+			path.push_back(node);
+			AddVirtualLoss(node);
+
+			if (expanded)
+				return node;
+			continue;
+		}
+
 		if (PreExpandTree(node))
-			return ExpandTree(node);
-		else
-			node = BestChild(node, Cp);
+		{
+			TreeNode *newNode = ExpandTree(node, id);
+			if (newNode != NULL)
+			{
+				newNode = Resolve(newNode);
+				path.push_back(newNode);
+				AddVirtualLoss(newNode);
+				return newNode;
+			}
+		}
+
+		// another thread may have claimed the last action without publishing the child yet
+		TreeNode *child = BestChild(node, Cp);
+		if (child == NULL)
+			return node;
+
+		game.Move(child->action);
+		node = Resolve(child);
+		path.push_back(node);
+		contexts[id].counters.selections++;
+		AddVirtualLoss(node);
 	}
 	return node;
 }
 
-bool MCTS::PreExpandTree(TreeNode *node)
+template <int N>
+bool MCTSN<N>::PreExpandTree(TreeNode *node)
 {
-	if (node->validActionCount > 0)
-	{
-		int id = rand() % node->validActionCount;
-		swap(node->validActions[id], node->validActions[node->validActionCount - 1]);
-	}
-	else
+	if (node->validActionCount <= 0)
 	{
 		// try grids with lower priority after certain visits
 		/*if (ENABLE_TRY_MORE_NODE && node->gridLevel == 0 && node->visit > TRY_MORE_NODE_THRESHOLD * node->children.size())
@@ -175,29 +635,199 @@ bool MCTS::PreExpandTree(TreeNode *node)
 	return node->validActionCount > 0;
 }
 
-TreeNode* MCTS::ExpandTree(TreeNode *node)
+// the action of the new child is the next one in order, unless one is given
+template <int N>
+TreeNode* MCTSN<N>::ExpandTree(TreeNode *node, int id, int action)
 {
-	int move = node->validActions[node->validActionCount - 1];
-	--(node->validActionCount);
+	GameBase &game = contexts[id].game;
+	SearchCounters &counters = contexts[id].counters;
+
+	// claim an action
+	int count = node->validActionCount;
+	while (count > 0 && !node->validActionCount.compare_exchange_weak(count, count - 1));
+
+	if (count <= 0)
+		return NULL;
+
+	int childId = node->actionCount - count;
+	int first;
+
+	if (childId == 0)
+	{
+		// the first expansion reserves slots for all children
+		first = AllocNodes(node->actionCount, id);
+		if (first < 0)
+		{
+			node->validActionCount = 0;
+			node->firstChild.store(ARENA_FULL, memory_order_release);
+			return NULL;
+		}
+
+		for (int i = 0; i < node->actionCount; ++i)
+		{
+			nodes[first + i].ready.store(false, memory_order_relaxed);
+			nodes[first + i].pendingAction.store(NO_ACTION, memory_order_relaxed);
+		}
+
+		node->firstChild.store(first, memory_order_release);
+	}
+	else if ((first = node->firstChild.load(memory_order_acquire)) == NO_CHILD)
+	{
+		auto start = chrono::steady_clock::now();
+		while ((first = node->firstChild.load(memory_order_acquire)) == NO_CHILD)
+			this_thread::yield();
+		counters.lockWaitNs += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+	}
+
+	// the first expansion may have found the arena full, whether this thread waited for it or not
+	if (first < 0)
+		return NULL;
+
+	if (action < 0)
+		action = GetAction(node, game, childId);
+	game.Move(action);
 
-	TreeNode *newNode = NewTreeNode(node);
-	node->children.push_back(newNode);
-	*(newNode->game) = *(node->game);
-	newNode->game->Move(move);
-	newNode->game->GetValidActions(newNode->validActions, newNode->validActionCount);
+	// link to the node of an equal state if there is one
+	TreeNode *newNode = &nodes[first + childId];
+	newNode->pendingAction.store(action, memory_order_relaxed);
+	int slice = contexts[id].tableSlice;
+	uint64_t key = TranspositionTable::MakeKey(game);
+	int linked = transTable.Lookup(key, slice);
+
+	if (linked >= 0)
+	{
+		newNode->InitLink(int(node - nodes), action, linked);
+		counters.links++;
+	}
+	else
+	{
+		newNode->Init(int(node - nodes), action, game, contexts[id].rng);
+		transTable.Store(key, first + childId, slice);
+	}
+	newNode->ready.store(true, memory_order_release);
+	counters.expansions++;
 
 	return newNode;
 }
 
-TreeNode* MCTS::BestChild(TreeNode *node, float c)
+// a spawn is drawn with its real probability, a spawn without a child is expanded while progressive widening
+// allows another child, otherwise an existing child is drawn by probability, so the tree stays deep and narrow
+template <int N>
+TreeNode* MCTSN<N>::ChanceChild(TreeNode *node, int id, bool &expanded)
+{
+	GameBase &game = contexts[id].game;
+	Random &random = contexts[id].rng;
+	int action = game.GetSpawnMove(random);
+	expanded = false;
+
+	// a slot claimed by another thread may hold the same spawn, it is only drawn again once it is ready
+	int first = node->firstChild.load(memory_order_acquire);
+	int childCount = first >= 0 ? node->actionCount - node->validActionCount : 0;
+	bool pending = false;
+	for (int i = 0; i < childCount; ++i)
+	{
+		TreeNode *child = &nodes[first + i];
+		if (child->ready.load(memory_order_acquire))
+		{
+			if (child->action == action)
+				return child;
+		}
+		else
+		{
+			int claimed = child->pendingAction.load(memory_order_relaxed);
+			pending = pending || claimed == action || claimed == NO_ACTION;
+		}
+	}
+
+	int allowed = (int)ceilf(WIDENING_C * powf((float)node->visit, WIDENING_ALPHA));
+	if (!pending && childCount < allowed && PreExpandTree(node))
+	{
+		TreeNode *newNode = ExpandTree(node, id, action);
+		if (newNode != NULL)
+		{
+			expanded = true;
+			return newNode;
+		}
+		first = node->firstChild.load(memory_order_acquire);
+		childCount = first >= 0 ? node->actionCount - node->validActionCount : 0;
+	}
+
+	float total = 0;
+	for (int i = 0; i < childCount; ++i)
+	{
+		if (nodes[first + i].ready.load(memory_order_acquire))
+			total += game.GetSpawnProbability(nodes[first + i].action);
+	}
+
+	float target = random.NextFloat() * total;
+	TreeNode *result = NULL;
+	for (int i = 0; i < childCount; ++i)
+	{
+		TreeNode *child = &nodes[first + i];
+		if (!child->ready.load(memory_order_acquire))
+			continue;
+
+		result = child;
+		target -= game.GetSpawnProbability(child->action);
+		if (target < 0)
+			break;
+	}
+	return result;
+}
+
+// the move is settled once the confidence interval of the child with the best win rate, which Search plays,
+// is separated from the intervals of all other children. values are in [0, 1] so the standard deviation of
+// a leaf is bounded by 0.5, and the visits of a batched leaf are correlated, so the samples are the leaves
+template <int N>
+bool MCTSN<N>::CanStopEarly(TreeNode *node)
+{
+	if (node->actionCount == 1)
+		return true;
+
+	float elapsed = chrono::duration<float>(chrono::steady_clock::now() - searchStart).count();
+	if (elapsed < searchTime * EARLY_STOP_MIN_RATIO || node->validActionCount > 0)
+		return false;
+
+	vector<TreeNode*> children = SortedChildren(node);
+	TreeNode *best = BestChild(node, 0);
+	if (children.size() < 2 || best == NULL)
+		return false;
+
+	best = Resolve(best);
+	float leafVisits = UseBatchRollout() ? ROLLOUT_BATCH : 1;
+	float lower = best->winRate - EARLY_STOP_Z * 0.5f / sqrtf(max(best->visit / leafVisits, 1.f));
+	for (auto slot : children)
+	{
+		TreeNode *child = Resolve(slot);
+		if (child == best)
+			continue;
+
+		float upper = child->winRate + EARLY_STOP_Z * 0.5f / sqrtf(max(child->visit / leafVisits, 1.f));
+		if (upper >= lower)
+			return false;
+	}
+	return true;
+}
+
+template <int N>
+TreeNode* MCTSN<N>::BestChild(TreeNode *node, float c)
 {
 	TreeNode *result = NULL;
 	float bestScore = -1;
-	float expandFactorParent_c = sqrtf(logf(node->visit)) * c;
+	float expandFactorParent_c = sqrtf(logf(node->visit + node->virtualLoss)) * c;
 
-	for (auto child : node->children)
+	int first = node->firstChild.load(memory_order_acquire);
+	if (first < 0)
+		return NULL;
+
+	int childCount = node->actionCount - node->validActionCount;
+	for (int i = 0; i < childCount; ++i)
 	{
-		float score = CalcScoreFast(child, expandFactorParent_c);
+		TreeNode *child = &nodes[first + i];
+		if (!child->ready.load(memory_order_acquire))
+			continue;
+
+		float score = CalcScoreFast(Resolve(child), expandFactorParent_c);
 		if (score > bestScore)
 		{
 			bestScore = score;
@@ -207,201 +837,448 @@ TreeNode* MCTS::BestChild(TreeNode *node, float c)
 	return result;
 }
 
-float MCTS::CalcScore(const TreeNode *node, float c, float logParentVisit)
+template <int N>
+float MCTSN<N>::CalcScore(const TreeNode *node, float c, float logParentVisit)
 {
 	float winRate = node->value / node->visit;
 	float expandFactor = c * sqrtf(logParentVisit / node->visit);
 
-	if (node->game->GetSide() == root->game->GetSide()) // win rate of opponent
+	if (node->side == root->side) // win rate of opponent
 		winRate = 1 - winRate;
 
 	return winRate + expandFactor;
 }
 
-float MCTS::CalcScoreFast(const TreeNode *node, float expandFactorParent_c)
+template <int N>
+float MCTSN<N>::CalcScoreFast(const TreeNode *node, float expandFactorParent_c)
+{
+	int virtualLoss = node->virtualLoss;
+	if (virtualLoss == 0)
+		return node->winRate + node->expandFactor * expandFactorParent_c;
+
+	// pending visits of other threads count as losses for the player choosing this node
+	int visit = node->visit;
+	float total = float(visit + virtualLoss);
+	return node->winRate * visit / total + expandFactorParent_c / sqrtf(total);
+}
+
+template <int N>
+void MCTSN<N>::AddVirtualLoss(TreeNode *node)
 {
-	return node->winRate + node->expandFactor * expandFactorParent_c;
+	if (ENABLE_LOCK_FREE && mode == E_TREE_PARALLEL)
+		node->virtualLoss += VIRTUAL_LOSS;
+}
+
+// children are expanded in the order of valid actions, starting from a random offset
+template <int N>
+int MCTSN<N>::GetAction(const TreeNode *node, const GameBase &game, int childId)
+{
+	array<uint8_t, GameBase::VALID_ACTION_MAX> actions;
+	int count;
+	game.GetValidActions(actions, count);
+
+	return actions[(childId + node->actionOffset) % count];
 }
 
-float MCTS::DefaultPolicy(TreeNode *node, int id)
+// returns the sum of the values of count rollouts
+template <int N>
+float MCTSN<N>::DefaultPolicy(TreeNode *node, int id, int &count)
 {
-	gameCache[id] = *(node->game);
+	GameBase &game = contexts[id].game;
+	SearchCounters &counters = contexts[id].counters;
+	int startTurn = game.turn;
 
 	float bestValue = 0;
 	int estimateCount = 0;
 
 	int turnCount = 0;
-	float timeRatio = clamp((gameCache[id].turn - 200.f) / 1000.f, 0.f, 1.f);
+	float timeRatio = clamp((game.turn - 200.f) / 1000.f, 0.f, 1.f);
 	int fastStopStep = FAST_STOP_STEPS_MIN * timeRatio + FAST_STOP_STEPS_MAX * (1 - timeRatio);
 
-	while (!gameCache[id].IsGameFinish())
+	count = 1;
+	counters.rollouts++;
+
+	// a learned evaluator replaces the rest of the rollout
+	if (evaluator != NULL)
 	{
-		int move = gameCache[id].GetNextMove();
-		gameCache[id].Move(move);
+		for (int i = 0; i < LEAF_ROLLOUT_STEPS && !game.IsGameFinish(); ++i)
+		{
+			game.Move(game.GetNextMove(contexts[id].rng, rolloutPolicy));
+			counters.rolloutSteps++;
+		}
+
+		if (game.IsGameFinish())
+			return game.state == GameBase::E_WIN ? 1.f : 0.f;
+
+		return 1.f / (1.f + expf((leafBaseline - EvaluateLeaf(game)) / LEAF_VALUE_SCALE));
+	}
+
+	// naive rollouts of the same leaf are played in lockstep, a leaf counts as several visits.
+	// the batch plays the 4x4 bitboard
+	if constexpr (N == BOARD_SIZE)
+	{
+		if (UseBatchRollout())
+		{
+			RolloutStats stats = {};
+			count = ROLLOUT_BATCH;
+			float value = contexts[id].batch.Run(game, count, fastStopStep, FAST_STOP_ESTIMATE_COUNT, contexts[id].rng, stats);
+
+			counters.rollouts += count - 1;
+			counters.rolloutSteps += stats.steps;
+			counters.fastStops += stats.fastStops;
+			counters.fastStopSteps += stats.fastStopSteps;
+			return value;
+		}
+	}
+
+	while (!game.IsGameFinish())
+	{
+		int move = game.GetNextMove(contexts[id].rng, rolloutPolicy);
+		game.Move(move);
+		counters.rolloutSteps++;
 
 		if (++turnCount > fastStopStep)
 		{
-			float value = gameCache[id].CalcFastStopScore();
+			float value = game.CalcFastStopScore();
 			bestValue = max(bestValue, value);
 
 			if (++estimateCount > FAST_STOP_ESTIMATE_COUNT)
 			{
-				fastStopCount++;
-				fastStopSteps += gameCache[id].turn - node->game->turn;
+				counters.fastStops++;
+				counters.fastStopSteps += game.turn - startTurn;
 				return bestValue;
 			}
 		}
 	}
 	float ratio = (float)turnCount / fastStopStep;
-	return gameCache[id].CalcFinishScore(ratio);
+	return game.CalcFinishScore(ratio);
 }
 
-void MCTS::UpdateValue(TreeNode *node, float value)
+// the network scores afterstates, so a state with the player to move takes its best afterstate
+// a leaf is scored by ROLLOUT_BATCH naive rollouts played together, their visits are counted separately
+template <int N>
+bool MCTSN<N>::UseBatchRollout() const
 {
-	while (node != NULL)
-	{
-		node->visit++;
-		node->value += value;
-
-		node->expandFactor = sqrtf(1.f / node->visit);
-		node->winRate = node->value / node->visit;
-
-		if (node->game->GetSide() == root->game->GetSide()) // win rate of opponent
-			node->winRate = 1 - node->winRate;
-
-		node = node->parent;
-	}
+	return N == BOARD_SIZE && ROLLOUT_BATCH > 1 && rolloutPolicy == GameBase::E_ROLLOUT_NAIVE && evaluator == NULL;
 }
 
-void MCTS::ClearNodes(TreeNode *node)
+template <int N>
+float MCTSN<N>::EvaluateLeaf(const GameBase &game)
 {
-	if (node != NULL)
+	// the network is trained on the 4x4 board, SetEvaluator keeps it off other sizes
+	if constexpr (N != BOARD_SIZE)
 	{
-		for (auto child : node->children)
+		return 0;
+	}
+	else
+	{
+		if (game.GetSide() == Board::E_SYSTEM)
+			return evaluator->Evaluate(game.board.grids);
+
+		float best = 0;
+		for (int d = 0; d < Board::E_DIRECTION_MAX; ++d)
 		{
-			ClearNodes(child);
+			Board next = game.board;
+			if (next.Move((Board::Direction)d))
+				best = max(best, evaluator->Evaluate(next.grids));
 		}
-
-		RecycleTreeNode(node);
+		return best;
 	}
 }
 
-TreeNode* MCTS::NewTreeNode(TreeNode *parent)
+template <int N>
+void MCTSN<N>::UpdateValue(const vector<TreeNode*> &path, float value, int count)
 {
-	if (pool.empty())
+	for (auto node : path)
 	{
-		TreeNode *node = new TreeNode(parent);
-		node->game = new GameBase();
-		return node;
+		int visit = (node->visit += count);
+		AtomicAdd(node->value, value);
+
+		if (ENABLE_LOCK_FREE && mode == E_TREE_PARALLEL)
+			node->virtualLoss -= VIRTUAL_LOSS;
+
+		float winRate = node->value / visit;
+		if (node->side == root->side) // win rate of opponent
+			winRate = 1 - winRate;
+
+		node->expandFactor = sqrtf(1.f / visit);
+		node->winRate = winRate;
 	}
+}
 
-	TreeNode *node = pool.back();
-	node->parent = parent;
-	pool.pop_back();
+// the whole tree lives in the arena, so clearing it is just a reset
+template <int N>
+void MCTSN<N>::ClearNodes()
+{
+	nodeCount = 0;
+	root = NULL;
+	transTable.Clear();
+}
 
-	return node;
+template <int N>
+void MCTSN<N>::SetSeed(uint64_t seed)
+{
+	rng.Seed(seed);
+}
+
+template <int N>
+void MCTSN<N>::SetSearchTime(float seconds)
+{
+	fixedSearchTime = seconds;
+}
+
+template <int N>
+void MCTSN<N>::SetRolloutPolicy(int policy)
+{
+	rolloutPolicy = policy;
 }
 
-void MCTS::RecycleTreeNode(TreeNode *node)
+template <int N>
+void MCTSN<N>::SetEvaluator(const NTuple *network)
 {
-	node->parent = NULL;
-	node->visit = 0;
-	node->value = 0;
-	node->winRate = 0;
-	node->expandFactor = 0;
-	node->validActionCount = 0;
-	node->gridLevel = 0;
-	node->children.clear();
+	evaluator = (N == BOARD_SIZE && network != NULL && !network->IsEmpty()) ? network : NULL;
+}
 
-	pool.push_back(node);
+template <int N>
+void MCTSN<N>::SetLogLevel(int level)
+{
+	logLevel = level;
 }
 
-void MCTS::ClearPool()
+template <int N>
+TreeNode* MCTSN<N>::Resolve(TreeNode *node)
 {
-	for (auto node : pool)
+	return node->link >= 0 ? &nodes[node->link] : node;
+}
+
+template <int N>
+TreeNode* MCTSN<N>::NewTreeNode(int parent, int action, const GameBase &game, int id)
+{
+	int index = AllocNodes(1, id);
+	if (index < 0)
+		return NULL;
+
+	TreeNode *node = &nodes[index];
+	node->Init(parent, action, game, id >= 0 ? contexts[id].rng : rng);
+	node->ready = true;
+
+	return node;
+}
+
+// a search thread of root-parallel search takes nodes from its own slice without touching the shared counter
+template <int N>
+int MCTSN<N>::AllocNodes(int count, int id)
+{
+	if (id >= 0 && mode == E_ROOT_PARALLEL)
 	{
-		delete node->game;
-		delete node;
+		Context &context = contexts[id];
+		if (context.nodeCount + count > context.nodeEnd)
+			return -1;
+
+		int first = context.nodeCount;
+		context.nodeCount += count;
+		return first;
 	}
+
+	int first = nodeCount.fetch_add(count);
+	if (first + count > NODE_ARENA_SIZE)
+		return -1;
+
+	return first;
 }
 
-void MCTS::PrintTree(TreeNode *node, int level)
+// root-parallel search reserves the children of the main root for the merged statistics,
+// the rest of the arena and the transposition table are split evenly between the search threads
+template <int N>
+void MCTSN<N>::SplitArena(int threadNum)
 {
-	if (level == 1)
+	if (mode != E_ROOT_PARALLEL)
 	{
-		int logId = node->game->turn / 100 + 1;
-		char logFile[20];
-		sprintf_s(logFile, 20, LOG_FILE_FORMAT, logId);
+		for (int i = 0; i < threadNum; ++i)
+			contexts[i].tableSlice = 0;
+		transTable.Split(1);
+		return;
+	}
 
-		freopen_s(&fp, logFile, "a+", stdout);
-		node->game->board.Print();
-		fclose(stdout);
-		freopen_s(&fp, "CON", "w", stdout);
+	int first = AllocNodes(root->actionCount);
+	for (int i = 0; i < root->actionCount; ++i)
+		nodes[first + i].ready = false;
+	root->firstChild = first;
 
-		fopen_s(&fp, logFile, "a+");
-		fprintf(fp, "===============================PrintTree=============================\n");
-		fprintf(fp, "visit: %d, value: %.1f, children: %d\n", node->visit, node->value, node->children.size());
+	int begin = nodeCount;
+	int slice = (NODE_ARENA_SIZE - begin) / threadNum;
+	for (int i = 0; i < threadNum; ++i)
+	{
+		Context &context = contexts[i];
+		context.root = NULL;
+		context.nodeBegin = begin + slice * i;
+		context.nodeEnd = context.nodeBegin + slice;
+		context.nodeCount = context.nodeBegin;
+		context.tableSlice = i;
 	}
+	transTable.Split(threadNum);
+}
 
-	if (level > maxDepth)
-		maxDepth = level;
+// sums the children of the private roots by action into the children of the main root,
+// only the main root and its children are filled, so the move choice and the logs see one tree
+template <int N>
+void MCTSN<N>::MergeRoots(int threadNum)
+{
+	array<uint8_t, GameBase::VALID_ACTION_MAX> actions;
+	int count;
+	rootGame.GetValidActions(actions, count);
 
-	node->children.sort([](const TreeNode *a, const TreeNode *b)
+	int first = root->firstChild;
+	for (int i = 0; i < count; ++i)
 	{
-		return a->visit > b->visit;
-	});
+		GameBase childGame = rootGame;
+		childGame.Move(actions[i]);
+		nodes[first + i].Init(0, actions[i], childGame, rng);
+		nodes[first + i].validActionCount = 0;
+	}
 
-	int i = 1;
-	for (auto it = node->children.begin(); it != node->children.end(); ++it)
+	for (int t = 0; t < threadNum; ++t)
 	{
-		fprintf(fp, "%d", level);
-		for (int j = 0; j < level; ++j)
-			fprintf(fp, "   ");
+		TreeNode *workerRoot = contexts[t].root;
+		if (workerRoot == NULL)
+			continue;
 
-		float expandFactorParent_c = sqrtf(logf(node->visit)) * Cp;
-		fprintf(fp, "visit: %d, value: %.1f, raw_score: %.6f, score: %.6f, children: %d, move: %s\n", (*it)->visit, (*it)->value, CalcScoreFast(*it, 0), CalcScoreFast(*it, expandFactorParent_c), (*it)->children.size(), (*it)->game->LastAction2Str().c_str());
-		PrintTree(*it, level + 1);
+		root->visit += workerRoot->visit;
+		AtomicAdd(root->value, workerRoot->value);
 
-		if (++i > 4)
-			break;
+		for (auto child : SortedChildren(workerRoot))
+		{
+			int i = int(find(actions.begin(), actions.begin() + count, child->action) - actions.begin());
+			TreeNode *node = Resolve(child);
+			nodes[first + i].visit += node->visit;
+			AtomicAdd(nodes[first + i].value, node->value);
+		}
 	}
 
-	if (level == 1)
+	for (int i = 0; i < count; ++i)
 	{
-		fprintf(fp,"================================TreeEnd============================\n\n");
-		fclose(fp);
+		TreeNode &merged = nodes[first + i];
+		int visit = merged.visit;
+		merged.ready = visit > 0;
+		if (visit == 0)
+			continue;
+
+		float winRate = merged.value / visit;
+		merged.winRate = merged.side == root->side ? 1 - winRate : winRate;
+		merged.expandFactor = sqrtf(1.f / visit);
 	}
+	root->validActionCount = 0;
+}
+
+template <int N>
+int MCTSN<N>::GetNodeCount() const
+{
+	if (mode != E_ROOT_PARALLEL)
+		return min((int)nodeCount, NODE_ARENA_SIZE);
+
+	int count = nodeCount;
+	for (int i = 0; i < threadNum; ++i)
+		count += contexts[i].nodeCount - contexts[i].nodeBegin;
+	return count;
 }
 
-void MCTS::PrintFullTree(TreeNode *node, int level)
+template <int N>
+vector<TreeNode*> MCTSN<N>::SortedChildren(TreeNode *node)
 {
-	if (level == 1)
+	vector<TreeNode*> children;
+	int first = node->firstChild;
+	if (first < 0)
+		return children;
+
+	int childCount = node->actionCount - node->validActionCount;
+	for (int i = 0; i < childCount; ++i)
 	{
-		fopen_s(&fp, LOG_FILE_FULL, "w");
-		fprintf(fp, "===============================PrintFullTree=============================\n");
-		fprintf(fp, "visit: %d, value: %.1f, children: %d\n", node->visit, node->value, node->children.size());
+		if (nodes[first + i].ready)
+			children.push_back(&nodes[first + i]);
 	}
 
-	node->children.sort([](const TreeNode *a, const TreeNode *b)
+	sort(children.begin(), children.end(), [this](TreeNode *a, TreeNode *b)
 	{
-		return a->visit > b->visit;
+		return Resolve(a)->visit > Resolve(b)->visit;
 	});
+	return children;
+}
 
-	int i = 1;
-	for (auto it = node->children.begin(); it != node->children.end(); ++it)
-	{
-		fprintf(fp, "%d", level);
-		for (int j = 0; j < level; ++j)
-			fprintf(fp, "   ");
+// one json object per move, fields are totals over all search threads, engine tells the engines of a process apart
+template <int N>
+void MCTSN<N>::LogStats(float elapsedTime, int reusedVisit, float winRate)
+{
+	if (statsFp == NULL)
+		return;
+
+	const SearchCounters &c = lastCounters;
+	TranspositionTable::Stats tt = transTable.GetStats();
+	lock_guard<mutex> lock(statsMtx);
+	fprintf(statsFp, "{\"engine\":%d,\"turn\":%d,\"plan\":%.3f,\"time\":%.4f,\"threads\":%d,\"iterations\":%d,\"reused\":%d,\"depth\":%d,\"nodes\":%d,"
+		"\"selections\":%lld,\"expansions\":%lld,\"links\":%lld,\"rollouts\":%lld,\"rollout_steps\":%lld,\"fast_stops\":%lld,\"fast_stop_steps\":%lld,"
+		"\"lock_wait_ms\":%.3f,\"move_cache_lookups\":%lld,\"move_cache_hits\":%lld,\"tt_lookups\":%d,\"tt_hits\":%d,\"early_stop\":%d,\"time_bank\":%.3f,\"win_rate\":%.4f}\n",
+		engineId, rootGame.turn, searchTime, elapsedTime, threadNum, lastStats.iteration, reusedVisit, c.maxDepth, GetNodeCount(),
+		(long long)c.selections, (long long)c.expansions, (long long)c.links, (long long)c.rollouts, (long long)c.rolloutSteps, (long long)c.fastStops, (long long)c.fastStopSteps,
+		c.lockWaitNs / 1e6, (long long)c.moveCacheLookups, (long long)c.moveCacheHits, tt.lookup, tt.hit, lastEarlyStop, timeBank, winRate);
+}
+
+template <int N>
+void MCTSN<N>::LogTree(int kind, int topK)
+{
+	TreeSnapshot snapshot;
+	snapshot.kind = kind;
+	snapshot.turn = rootGame.turn;
+	snapshot.c = Cp;
+	snapshot.size = N;
+	snapshot.grids = FoldGrids(rootGame.board.grids);
+	CaptureTree(root, 0, topK, snapshot.nodes);
+
+	logger.Push(move(snapshot));
+}
 
-		float expandFactorParent_c = sqrtf(logf(node->visit)) * Cp;
-		fprintf(fp, "visit: %d, value: %.1f, raw_score: %.6f, score: %.6f, children: %d, move: %s\n", (*it)->visit, (*it)->value, CalcScoreFast(*it, 0), CalcScoreFast(*it, expandFactorParent_c), (*it)->children.size(), (*it)->game->LastAction2Str().c_str());
-		PrintFullTree(*it, level + 1);
+// appends the subtree in preorder, topK == 0 keeps every child in arena order
+template <int N>
+void MCTSN<N>::CaptureTree(TreeNode *node, int action, int topK, vector<SnapshotNode> &result)
+{
+	vector<TreeNode*> children;
+	if (topK > 0)
+	{
+		children = SortedChildren(node);
+	}
+	else if (node->firstChild >= 0)
+	{
+		int first = node->firstChild;
+		int childCount = node->actionCount - node->validActionCount;
+		for (int i = 0; i < childCount; ++i)
+		{
+			if (nodes[first + i].ready)
+				children.push_back(&nodes[first + i]);
+		}
 	}
 
-	if (level == 1)
+	int index = (int)result.size();
+	SnapshotNode snapshotNode;
+	snapshotNode.visit = node->visit;
+	snapshotNode.value = node->value;
+	snapshotNode.winRate = node->winRate;
+	snapshotNode.action = action;
+	snapshotNode.side = node->side;
+	snapshotNode.childCount = 0;
+	snapshotNode.totalChildren = (uint8_t)children.size();
+	result.push_back(snapshotNode);
+
+	for (auto child : children)
 	{
-		fprintf(fp, "================================TreeEnd============================\n\n");
-		fclose(fp);
+		// linked nodes are captured once per parent, the cap bounds the size of a full snapshot
+		if ((topK > 0 && result[index].childCount >= topK) || (int)result.size() >= SNAPSHOT_NODE_MAX)
+			break;
+
+		result[index].childCount++;
+		CaptureTree(Resolve(child), child->action, topK, result);
 	}
 }
+
+template class MCTSN<3>;
+template class MCTSN<4>;
+template class MCTSN<5>;
+template class MCTSN<6>;
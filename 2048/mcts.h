@@ -1,61 +1,198 @@
 #pragma once
-#include <list>
-#include <ctime>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <chrono>
 #include "game.h"
+#include "transposition.h"
+#include "logger.h"
+#include "ntuple.h"
+#include "movecache.h"
+#include "rollout.h"
+#include "scheduler.h"
 
 const int THREAD_NUM_MAX = 32;
+const int NODE_ARENA_SIZE = 1 << 21;
 
+static_assert(THREAD_NUM_MAX <= TRANS_TABLE_SLICE_MAX, "every private tree needs a transposition table slice");
+
+// nodes live in the MCTS arena and refer to each other by index,
+// the game state of a node is recomputed by replaying actions from the root
 class TreeNode
 {
 public:
-	TreeNode(TreeNode *p);
-
-	int visit;
-	float value;
-	float winRate;
-	float expandFactor;
-	int validActionCount;
-	int gridLevel;
-	GameBase *game;
-
-	TreeNode *parent;
-	list<TreeNode*> children;
-	array<uint8_t, VALID_ACTION_MAX> validActions;
+	template <class GameType>
+	void Init(int p, int a, const GameType &game, Random &rng);
+	void InitLink(int p, int a, int l);
+
+	// hot fields read by BestChild
+	atomic<float> winRate;
+	atomic<float> expandFactor;
+	atomic<int> visit;
+	atomic<int> virtualLoss;
+	atomic<float> value;
+
+	// children occupy [firstChild, firstChild + actionCount) once the first one is expanded,
+	// a child slot can be read after its ready flag is set
+	atomic<int> firstChild;
+	atomic<int> validActionCount;
+	atomic<bool> ready;
+	atomic<uint8_t> pendingAction; // action of a claimed slot before it is ready, so a spawn isn't expanded twice
+	int link; // a slot reaching a state already in the tree only links to that node
+	int parent;
+	uint8_t action;
+	uint8_t side;
+	uint8_t actionCount;
+	uint8_t actionOffset;
+};
+
+// counters of one search thread, written only by that thread and summed after the search
+struct SearchCounters
+{
+	int64_t selections;		// tree policy steps through existing children
+	int64_t expansions;
+	int64_t links;			// expansions that reached a state already in the tree
+	int64_t rollouts;
+	int64_t rolloutSteps;
+	int64_t fastStops;
+	int64_t fastStopSteps;
+	int64_t lockWaitNs;		// waiting for the tree mutex or for a child block being published
+	int64_t moveCacheLookups;
+	int64_t moveCacheHits;
+	int maxDepth;
+
+	void Clear();
+	void Merge(const SearchCounters &other);
+};
+
+// state owned by one search thread, aligned so threads don't share cache lines
+template <int N>
+struct alignas(64) SearchContext
+{
+	GameBaseN<N> game;
+	vector<TreeNode*> path;
+	Random rng;
+	MoveCacheN<N> moveCache;
+	BatchRollout batch; // plays the 4x4 bitboard, unused on other sizes
+	SearchCounters counters;
+
+	// root searched by this thread, the private tree of root-parallel search takes nodes from [nodeBegin, nodeEnd) of the arena
+	TreeNode *root;
+	int nodeBegin, nodeEnd, nodeCount;
+	int startVisit, iteration;
+	bool started; // the first slice on a shared scheduler prepares the context
+	int tableSlice; // transposition table slice of the private tree, 0 when the tree is shared
 };
 
-class MCTS
+// the search of an NxN game, MCTS searches the 4x4 game. the n-tuple evaluator and batch rollouts
+// work on the 4x4 bitboard, other sizes score leaves with scalar rollouts
+template <int N>
+class MCTSN : public SearchEngineN<N>
 {
+	using GameBase = GameBaseN<N>;
+	using Game = GameN<N>;
+	using Context = SearchContext<N>;
+	using SearchEngineN<N>::verbose;
+	using SearchEngineN<N>::lastStats;
+	using SearchEngineN<N>::CalcTimeRatio;
+	using SearchEngineN<N>::CalcSearchTime;
+
 public:
-	MCTS(int mode = 0);
-	~MCTS();
+	enum ParallelMode
+	{
+		E_TREE_PARALLEL,	// all threads search one shared tree, lock free with virtual loss
+		E_ROOT_PARALLEL,	// every thread searches a private tree, the root children are merged at the deadline
+	};
+
+	// with a scheduler the search runs on its shared workers instead of threads of its own
+	MCTSN(int mode = E_TREE_PARALLEL, int threadNum = 0, int transTableMB = TRANS_TABLE_SIZE_MB, SearchScheduler *scheduler = NULL);
+	~MCTSN();
 	int Search(Game *state);
+	void SetSeed(uint64_t seed);
+	void SetLogLevel(int level);
+	void SetSearchTime(float seconds); // time of every search, 0 plans it from the position
+	void SetRolloutPolicy(int policy);
+	void SetEvaluator(const NTuple *network);
+	const SearchCounters& GetLastCounters() const { return lastCounters; }
 
 private:
-	static void SearchThread(int id, int seed, MCTS *mcts, clock_t startTime, float searchTime);
+	static void WorkerThread(int id, MCTSN *mcts);
+	static void SearchThread(int id, uint64_t seed, MCTSN *mcts, chrono::steady_clock::time_point deadline);
+	void StartSearch(int id, uint64_t seed);
+	bool RunIterations(int id, int count, chrono::steady_clock::time_point deadline);
+	bool RunSlice(int id);
 
 	// standard MCTS process
-	TreeNode* TreePolicy(TreeNode *node);
-	TreeNode* ExpandTree(TreeNode *node);
+	TreeNode* TreePolicy(TreeNode *node, int id);
+	TreeNode* ExpandTree(TreeNode *node, int id, int action = -1);
+	TreeNode* ChanceChild(TreeNode *node, int id, bool &expanded);
+	bool CanStopEarly(TreeNode *node);
 	TreeNode* BestChild(TreeNode *node, float c);
-	float DefaultPolicy(TreeNode *node, int id);
-	void UpdateValue(TreeNode *node, float value);
+	float DefaultPolicy(TreeNode *node, int id, int &count);
+	bool UseBatchRollout() const;
+	float EvaluateLeaf(const GameBase &game);
+	void UpdateValue(const vector<TreeNode*> &path, float value, int count);
 
 	// custom optimization
 	bool PreExpandTree(TreeNode *node);
 
-	void ClearNodes(TreeNode *node);
+	void ClearNodes();
+	void SplitArena(int threadNum);
+	void MergeRoots(int threadNum);
+	int GetNodeCount() const;
+	bool ReuseTree(const GameBase &game);
+	void CopySubtree(const TreeNode *node, const GameBase &game, int id, int parent, int action, int &count, unordered_map<int, int> &copied);
+	TreeNode* Resolve(TreeNode *node);
 	float CalcScore(const TreeNode *node, float c, float logParentVisit);
 	float CalcScoreFast(const TreeNode *node, float expandFactorParent_c);
-	void PrintTree(TreeNode *node, int level = 1);
-	void PrintFullTree(TreeNode *node, int level = 1);
+	void AddVirtualLoss(TreeNode *node);
+	int GetAction(const TreeNode *node, const GameBase &game, int childId);
+	vector<TreeNode*> SortedChildren(TreeNode *node);
+	void LogStats(float elapsedTime, int reusedVisit, float winRate);
+	void LogTree(int kind, int topK);
+	void CaptureTree(TreeNode *node, int action, int topK, vector<SnapshotNode> &result);
 
-	TreeNode* NewTreeNode(TreeNode *parent);
-	void RecycleTreeNode(TreeNode *node);
-	void ClearPool();
+	TreeNode* NewTreeNode(int parent, int action, const GameBase &game, int id = -1);
+	int AllocNodes(int count, int id = -1);
 
-	int maxDepth, fastStopSteps, fastStopCount;
-	GameBase gameCache[THREAD_NUM_MAX];
-	list<TreeNode*> pool;
+	Context contexts[THREAD_NUM_MAX];
+	SearchCounters lastCounters;
+	Random rng;
+	GameBase rootGame;
 	TreeNode *root;
 	int mode;
+	int rolloutPolicy;
+	const NTuple *evaluator;
+	float leafBaseline;
+
+	TreeNode *nodes, *spareNodes;
+	atomic<int> nodeCount;
+	TranspositionTable transTable;
+	TreeLogger logger;
+	int logLevel;
+	FILE *statsFp; // shared by all engines
+	int engineId;
+
+	// search workers live as long as the MCTS object and sleep between searches
+	int threadNum;
+	SearchScheduler *scheduler;
+	vector<thread> workers;
+	mutex workerMtx;
+	condition_variable workerCv, doneCv;
+	int searchGeneration, runningWorkers;
+	bool stopWorkers;
+	array<uint64_t, THREAD_NUM_MAX> workerSeeds;
+	chrono::steady_clock::time_point searchDeadline, searchStart;
+	float searchTime;
+	atomic<bool> stopSearch;
+
+	// seconds saved by early stops, reset when a new game starts
+	float timeBank;
+	int lastTurn;
+	float fixedSearchTime;
+	bool lastEarlyStop;
 };
+
+using MCTS = MCTSN<BOARD_SIZE>;
@@ -0,0 +1,60 @@
+#include "movecache.h"
+#include <cstring>
+
+const uint64_t MOVE_CACHE_HASH = 0x9e3779b97f4a7c15ULL;
+
+template <int N>
+MoveCacheN<N>::MoveCacheN(int bits)
+{
+	bits = clamp(bits, 1, 24);
+	shift = 64 - bits;
+
+	// every grid of the largest value, never reached in a game
+	Grids empty;
+	memset(&empty, 0xff, sizeof(empty));
+
+	entries.resize((size_t)1 << bits);
+	for (auto &entry : entries)
+		entry.grids = empty;
+
+	ResetStats();
+}
+
+template <int N>
+const typename MoveCacheN<N>::Entry& MoveCacheN<N>::Get(const BoardType &board)
+{
+	Entry &entry = entries[(FoldGrids(board.grids) * MOVE_CACHE_HASH) >> shift];
+
+	++lookups;
+	if (entry.grids == board.grids)
+	{
+		++hits;
+		return entry;
+	}
+
+	entry.grids = board.grids;
+	entry.legalMask = 0;
+	for (int d = 0; d < Board::E_DIRECTION_MAX; ++d)
+	{
+		BoardType next = board;
+		next.maxValue = 0;
+		if (next.Move((Board::Direction)d))
+			entry.legalMask |= 1 << d;
+
+		entry.results[d] = next.grids;
+		entry.maxValues[d] = next.maxValue;
+	}
+	return entry;
+}
+
+template <int N>
+void MoveCacheN<N>::ResetStats()
+{
+	lookups = 0;
+	hits = 0;
+}
+
+template class MoveCacheN<3>;
+template class MoveCacheN<4>;
+template class MoveCacheN<5>;
+template class MoveCacheN<6>;
@@ -0,0 +1,37 @@
+#pragma once
+#include "game.h"
+
+const int MOVE_CACHE_BITS = 12;
+
+// direct mapped cache from a board to the results of all 4 moves, owned by a single thread,
+// the legal mask is what GetValidActions, the rollout policies and the lose check need
+template <int N>
+class MoveCacheN
+{
+public:
+	using BoardType = BoardOf<N>;
+	using Grids = decltype(BoardType::grids);
+
+	struct Entry
+	{
+		Grids grids;
+		array<Grids, Board::E_DIRECTION_MAX> results;
+		array<uint8_t, Board::E_DIRECTION_MAX> maxValues;	// largest tile after the move
+		uint8_t legalMask;									// bit d is set if direction d changes the board
+	};
+
+	MoveCacheN(int bits = MOVE_CACHE_BITS);
+
+	const Entry& Get(const BoardType &board);
+
+	void ResetStats();
+	int64_t GetLookups() const { return lookups; }
+	int64_t GetHits() const { return hits; }
+
+private:
+	vector<Entry> entries;
+	int shift;
+	int64_t lookups, hits;
+};
+
+using MoveCache = MoveCacheN<BOARD_SIZE>;
@@ -0,0 +1,189 @@
+#include "ntuple.h"
+
+const uint32_t NTUPLE_MAGIC = 0x4c50544e; // "NTPL"
+const uint32_t NTUPLE_VERSION = 1;
+
+struct NTupleHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t patternCount;
+	uint32_t boardSize;
+};
+
+NTuple::NTuple(const vector<vector<int>> &patterns)
+{
+	for (auto &ids : patterns)
+		AddPattern(ids);
+}
+
+// two straight and two rectangular 6-tuples, the usual choice for a 4x4 board
+vector<vector<int>> NTuple::DefaultPatterns()
+{
+	return {
+		{ 0, 1, 2, 3, 4, 5 },
+		{ 4, 5, 6, 7, 8, 9 },
+		{ 0, 1, 2, 4, 5, 6 },
+		{ 4, 5, 6, 8, 9, 10 },
+	};
+}
+
+void NTuple::AddPattern(const vector<int> &ids)
+{
+	Pattern pattern;
+	pattern.size = min((int)ids.size(), NTUPLE_PATTERN_SIZE_MAX);
+
+	for (int i = 0; i < pattern.size; ++i)
+	{
+		pattern.ids[i] = ids[i];
+		for (int s = 0; s < NTUPLE_SYMMETRY_NUM; ++s)
+			pattern.shifts[s][i] = Symmetry(ids[i], s) * 4;
+	}
+
+	patterns.push_back(move(pattern));
+
+	auto &weights = patterns.back().weights;
+	weights = vector<atomic<float>>((size_t)1 << (patterns.back().size * 4));
+	for (auto &weight : weights)
+		weight.store(0.f, memory_order_relaxed);
+}
+
+// symmetry 0-3 rotate the board by 90 degrees each, 4-7 also mirror it
+int NTuple::Symmetry(int id, int symmetry)
+{
+	int row, col;
+	Board::Id2Coord(id, row, col);
+
+	if (symmetry >= 4)
+		col = BOARD_SIZE - 1 - col;
+
+	for (int i = 0; i < symmetry % 4; ++i)
+	{
+		int temp = row;
+		row = col;
+		col = BOARD_SIZE - 1 - temp;
+	}
+	return Board::Coord2Id(row, col);
+}
+
+int NTuple::GetIndex(uint64_t grids, const array<uint8_t, NTUPLE_PATTERN_SIZE_MAX> &shifts, int size)
+{
+	int index = 0;
+	for (int i = 0; i < size; ++i)
+		index |= ((grids >> shifts[i]) & 0xf) << (i * 4);
+	return index;
+}
+
+float NTuple::Evaluate(uint64_t grids) const
+{
+	float value = 0;
+	for (auto &pattern : patterns)
+	{
+		for (int s = 0; s < NTUPLE_SYMMETRY_NUM; ++s)
+			value += pattern.weights[GetIndex(grids, pattern.shifts[s], pattern.size)].load(memory_order_relaxed);
+	}
+	return value;
+}
+
+void NTuple::Update(uint64_t grids, float delta)
+{
+	for (auto &pattern : patterns)
+	{
+		for (int s = 0; s < NTUPLE_SYMMETRY_NUM; ++s)
+		{
+			atomic<float> &weight = pattern.weights[GetIndex(grids, pattern.shifts[s], pattern.size)];
+			weight.store(weight.load(memory_order_relaxed) + delta, memory_order_relaxed);
+		}
+	}
+}
+
+// a cell outside the board would shift past the 64 bit board, a repeated one would index the wrong weight
+static bool IsValidPattern(const uint8_t *cells, int size)
+{
+	for (int i = 0; i < size; ++i)
+	{
+		if (cells[i] >= GRID_NUM || find(cells, cells + i, cells[i]) != cells + i)
+			return false;
+	}
+	return true;
+}
+
+bool NTuple::Load(const char *file)
+{
+	FILE *fp = fopen(file, "rb");
+	if (fp == NULL)
+		return false;
+
+	NTupleHeader header;
+	bool ok = fread(&header, sizeof(header), 1, fp) == 1
+		&& header.magic == NTUPLE_MAGIC && header.version == NTUPLE_VERSION && header.boardSize == BOARD_SIZE;
+
+	vector<vector<int>> ids;
+	for (uint32_t i = 0; ok && i < header.patternCount; ++i)
+	{
+		uint8_t size;
+		uint8_t cells[NTUPLE_PATTERN_SIZE_MAX];
+		ok = fread(&size, 1, 1, fp) == 1 && size > 0 && size <= NTUPLE_PATTERN_SIZE_MAX && fread(cells, 1, size, fp) == size && IsValidPattern(cells, size);
+		if (ok)
+			ids.push_back(vector<int>(cells, cells + size));
+	}
+
+	if (ok)
+	{
+		patterns.clear();
+		for (auto &pattern : ids)
+			AddPattern(pattern);
+
+		vector<float> buffer;
+		for (auto &pattern : patterns)
+		{
+			buffer.resize(pattern.weights.size());
+			ok = ok && fread(buffer.data(), sizeof(float), buffer.size(), fp) == buffer.size();
+			for (size_t i = 0; ok && i < buffer.size(); ++i)
+				pattern.weights[i].store(buffer[i], memory_order_relaxed);
+		}
+
+		if (!ok)
+			patterns.clear();
+	}
+
+	fclose(fp);
+	return ok;
+}
+
+bool NTuple::Save(const char *file) const
+{
+	FILE *fp = fopen(file, "wb");
+	if (fp == NULL)
+		return false;
+
+	NTupleHeader header;
+	header.magic = NTUPLE_MAGIC;
+	header.version = NTUPLE_VERSION;
+	header.patternCount = (uint32_t)patterns.size();
+	header.boardSize = BOARD_SIZE;
+
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+	for (auto &pattern : patterns)
+	{
+		uint8_t size = pattern.size;
+		uint8_t cells[NTUPLE_PATTERN_SIZE_MAX];
+		for (int i = 0; i < pattern.size; ++i)
+			cells[i] = pattern.ids[i];
+
+		ok = ok && fwrite(&size, 1, 1, fp) == 1 && fwrite(cells, 1, size, fp) == size;
+	}
+
+	// weights may still be trained by other threads, each one is read once
+	vector<float> buffer;
+	for (auto &pattern : patterns)
+	{
+		buffer.resize(pattern.weights.size());
+		for (size_t i = 0; i < buffer.size(); ++i)
+			buffer[i] = pattern.weights[i].load(memory_order_relaxed);
+		ok = ok && fwrite(buffer.data(), sizeof(float), buffer.size(), fp) == buffer.size();
+	}
+
+	fclose(fp);
+	return ok;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <atomic>
+#include "game.h"
+
+const int NTUPLE_PATTERN_SIZE_MAX = 6;
+const int NTUPLE_SYMMETRY_NUM = 8;
+
+// n-tuple network, the value of a board is the sum of the weights of a few grid patterns
+// under all 8 rotations and reflections, a weight is indexed by the tile values covered by the pattern
+class NTuple
+{
+public:
+	NTuple() {}
+	NTuple(const vector<vector<int>> &patterns);
+
+	float Evaluate(uint64_t grids) const;
+	bool IsEmpty() const { return patterns.empty(); }
+
+	// adds delta to every weight read by Evaluate, threads may update concurrently without locks
+	void Update(uint64_t grids, float delta);
+	int GetFeatureCount() const { return (int)patterns.size() * NTUPLE_SYMMETRY_NUM; }
+
+	// weights are stored as raw floats after a small header describing the patterns
+	bool Load(const char *file);
+	bool Save(const char *file) const;
+
+	static vector<vector<int>> DefaultPatterns();
+
+private:
+	struct Pattern
+	{
+		int size;
+		array<int, NTUPLE_PATTERN_SIZE_MAX> ids;
+		array<array<uint8_t, NTUPLE_PATTERN_SIZE_MAX>, NTUPLE_SYMMETRY_NUM> shifts;
+		vector<atomic<float>> weights;	// relaxed atomics, a lost update only costs a little learning
+	};
+
+	void AddPattern(const vector<int> &ids);
+	static int GetIndex(uint64_t grids, const array<uint8_t, NTUPLE_PATTERN_SIZE_MAX> &shifts, int size);
+	static int Symmetry(int id, int symmetry);
+
+	vector<Pattern> patterns;
+};
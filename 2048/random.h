@@ -0,0 +1,52 @@
+#pragma once
+#include <cstdint>
+
+// xoroshiro128+ generator, small enough to keep one per thread or per game
+class Random
+{
+public:
+	Random(uint64_t seed = 1) { Seed(seed); }
+
+	// expand the seed with splitmix64, so that close seeds give unrelated sequences
+	void Seed(uint64_t seed)
+	{
+		for (int i = 0; i < 2; ++i)
+		{
+			uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+			state[i] = z ^ (z >> 31);
+		}
+	}
+
+	uint64_t Next()
+	{
+		uint64_t s0 = state[0];
+		uint64_t s1 = state[1];
+		uint64_t result = s0 + s1;
+
+		s1 ^= s0;
+		state[0] = Rotl(s0, 24) ^ s1 ^ (s1 << 16);
+		state[1] = Rotl(s1, 37);
+		return result;
+	}
+
+	// uniform in [0, n), uses the high bits which are the strongest ones of xoroshiro128+
+	int NextInt(int n)
+	{
+		return (int)(((Next() >> 32) * (uint64_t)n) >> 32);
+	}
+
+	float NextFloat()
+	{
+		return (Next() >> 40) * (1.f / 16777216.f);
+	}
+
+private:
+	static uint64_t Rotl(uint64_t x, int k)
+	{
+		return (x << k) | (x >> (64 - k));
+	}
+
+	uint64_t state[2];
+};
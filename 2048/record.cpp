@@ -0,0 +1,217 @@
+#include "record.h"
+#include <cstddef>
+#include <cstring>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+const uint32_t RECORD_MAGIC = 0x43455247; // "GREC"
+const uint32_t RECORD_VERSION = 1;
+
+// in front of the records, the size lets a reader reject records of another layout
+struct RecordHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t recordSize;
+	uint32_t reserved;
+};
+
+static_assert(sizeof(RecordHeader) == 16, "record header should have no padding");
+
+// fnv-1a
+uint32_t GameRecord::CalcChecksum() const
+{
+	const uint8_t *bytes = (const uint8_t*)this;
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < offsetof(GameRecord, checksum); ++i)
+		hash = (hash ^ bytes[i]) * 16777619u;
+	return hash;
+}
+
+RecordWriter::RecordWriter()
+{
+	fp = NULL;
+	nextGameId = 0;
+	buffer.reserve(RECORD_BUFFER_SIZE);
+}
+
+RecordWriter::~RecordWriter()
+{
+	Close();
+}
+
+// an existing file is appended to, so several runs can fill one file
+bool RecordWriter::Open(const char *path)
+{
+	Close();
+
+	lock_guard<mutex> lock(mtx);
+	nextGameId = 0;
+	fp = fopen(path, "ab");
+	if (fp == NULL)
+		return false;
+
+	fseek(fp, 0, SEEK_END);
+	long size = ftell(fp);
+	if (size == 0)
+	{
+		RecordHeader header = { RECORD_MAGIC, RECORD_VERSION, sizeof(GameRecord), 0 };
+		fwrite(&header, sizeof(header), 1, fp);
+		fflush(fp);
+	}
+	else
+	{
+		// game ids go on after the games already in the file, a torn last record would shift every new one.
+		// games played at the same time interleave their records, so the largest id may be anywhere
+		RecordReader reader;
+		if (size < (long)sizeof(RecordHeader) || (size - sizeof(RecordHeader)) % sizeof(GameRecord) != 0 || !reader.Open(path))
+		{
+			fclose(fp);
+			fp = NULL;
+			return false;
+		}
+		for (size_t i = 0; i < reader.GetCount(); ++i)
+		{
+			if (reader[i].checksum == reader[i].CalcChecksum())
+				nextGameId = max(nextGameId, reader[i].gameId + 1);
+		}
+	}
+	return true;
+}
+
+void RecordWriter::Close()
+{
+	lock_guard<mutex> lock(mtx);
+	if (fp == NULL)
+		return;
+
+	FlushLocked();
+	fclose(fp);
+	fp = NULL;
+}
+
+uint32_t RecordWriter::BeginGame()
+{
+	lock_guard<mutex> lock(mtx);
+	return nextGameId++;
+}
+
+void RecordWriter::Write(GameRecord &record)
+{
+	record.checksum = record.CalcChecksum();
+
+	lock_guard<mutex> lock(mtx);
+	if (fp == NULL)
+		return;
+
+	buffer.push_back(record);
+	if ((int)buffer.size() >= RECORD_BUFFER_SIZE)
+		FlushLocked();
+}
+
+void RecordWriter::Flush()
+{
+	lock_guard<mutex> lock(mtx);
+	FlushLocked();
+}
+
+void RecordWriter::FlushLocked()
+{
+	if (fp == NULL || buffer.empty())
+		return;
+
+	fwrite(buffer.data(), sizeof(GameRecord), buffer.size(), fp);
+	fflush(fp);
+	buffer.clear();
+}
+
+RecordReader::RecordReader()
+{
+	records = NULL;
+	count = 0;
+	mapping = NULL;
+	mappingSize = 0;
+}
+
+RecordReader::~RecordReader()
+{
+	Close();
+}
+
+// a partly written last record is ignored
+bool RecordReader::Open(const char *path)
+{
+	Close();
+
+#ifndef _WIN32
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(RecordHeader))
+	{
+		close(fd);
+		return false;
+	}
+
+	mappingSize = info.st_size;
+	mapping = mmap(NULL, mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapping == MAP_FAILED)
+	{
+		mapping = NULL;
+		return false;
+	}
+
+	const RecordHeader *header = (const RecordHeader*)mapping;
+	if (header->magic != RECORD_MAGIC || header->version != RECORD_VERSION || header->recordSize != sizeof(GameRecord))
+	{
+		Close();
+		return false;
+	}
+
+	records = (const GameRecord*)((const char*)mapping + sizeof(RecordHeader));
+	count = (mappingSize - sizeof(RecordHeader)) / sizeof(GameRecord);
+	madvise(mapping, mappingSize, MADV_SEQUENTIAL);
+	return true;
+#else
+	FILE *fp = fopen(path, "rb");
+	if (fp == NULL)
+		return false;
+
+	RecordHeader header;
+	if (fread(&header, sizeof(header), 1, fp) != 1 || header.magic != RECORD_MAGIC || header.version != RECORD_VERSION || header.recordSize != sizeof(GameRecord))
+	{
+		fclose(fp);
+		return false;
+	}
+
+	GameRecord record;
+	while (fread(&record, sizeof(record), 1, fp) == 1)
+		fallback.push_back(record);
+	fclose(fp);
+
+	records = fallback.data();
+	count = fallback.size();
+	return true;
+#endif
+}
+
+void RecordReader::Close()
+{
+#ifndef _WIN32
+	if (mapping != NULL)
+		munmap(mapping, mappingSize);
+#endif
+	mapping = NULL;
+	mappingSize = 0;
+	records = NULL;
+	count = 0;
+	fallback.clear();
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <mutex>
+#include "game.h"
+
+const int RECORD_BUFFER_SIZE = 4096; // records kept in memory before a write
+
+// one move of a game, fixed size so a file can be used as an array, fields are in host byte order
+struct GameRecord
+{
+	uint64_t grids;			// board before the move, 4 bits per grid like Board::grids
+	uint32_t gameId;
+	uint32_t turn;			// turn of the board
+	uint32_t iterations;	// search iterations spent on the move, 0 without a search
+	float searchTime;		// seconds
+	uint16_t winRate;		// win rate of the chosen move scaled to [0, 65535]
+	uint8_t move;			// direction in the low 4 bits, game state after the move in the high 4 bits
+	uint8_t spawn;			// GameBase::EncodeAction of the spawned tile, 0 if none
+	uint32_t checksum;		// of the bytes in front of it
+
+	int GetDirection() const { return move & 0xf; }
+	int GetState() const { return move >> 4; }
+	uint32_t CalcChecksum() const;
+};
+
+static_assert(sizeof(GameRecord) == 32, "game record should have no padding");
+
+// appends the records of any number of games to one file, records are buffered and written in blocks.
+// a game gets its id from BeginGame, writes from several threads are serialized
+class RecordWriter
+{
+public:
+	RecordWriter();
+	~RecordWriter();
+
+	bool Open(const char *path);
+	void Close();
+	bool IsOpen() const { return fp != NULL; }
+
+	uint32_t BeginGame();
+	void Write(GameRecord &record);
+	void Flush();
+
+private:
+	void FlushLocked();
+
+	FILE *fp;
+	uint32_t nextGameId;
+	vector<GameRecord> buffer;
+	mutex mtx;
+};
+
+// maps a record file into memory, the records are read in place
+class RecordReader
+{
+public:
+	RecordReader();
+	~RecordReader();
+
+	bool Open(const char *path);
+	void Close();
+
+	size_t GetCount() const { return count; }
+	const GameRecord* GetRecords() const { return records; }
+	const GameRecord& operator[](size_t i) const { return records[i]; }
+
+private:
+	const GameRecord *records;
+	size_t count;
+
+	void *mapping;
+	size_t mappingSize;
+	vector<GameRecord> fallback; // where memory mapping isn't available
+};
@@ -0,0 +1,82 @@
+#include "record.h"
+#include <chrono>
+#include <unordered_map>
+
+// summary of a game record file: checks every checksum, replays every move with its spawn
+// against the next record of the same game and counts the positions and max tiles
+
+static int MaxValue(uint64_t grids)
+{
+	int result = 0;
+	for (; grids != 0; grids >>= 4)
+		result = max(result, (int)(grids & 0xf));
+	return result;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2)
+	{
+		printf("usage: records FILE\n");
+		return 1;
+	}
+
+	auto start = chrono::steady_clock::now();
+
+	RecordReader reader;
+	if (!reader.Open(argv[1]))
+	{
+		printf("can't read game records from %s\n", argv[1]);
+		return 1;
+	}
+
+	// the next board of each game, games of several writers may be interleaved
+	unordered_map<uint32_t, uint64_t> expected;
+	unordered_map<uint32_t, int> maxValues;
+	long long checksumErrors = 0, replayErrors = 0, iterations = 0;
+
+	for (size_t i = 0; i < reader.GetCount(); ++i)
+	{
+		const GameRecord &record = reader[i];
+		if (record.CalcChecksum() != record.checksum)
+		{
+			++checksumErrors;
+			continue;
+		}
+
+		auto it = expected.find(record.gameId);
+		if (it != expected.end() && it->second != record.grids)
+			++replayErrors;
+
+		Board board;
+		board.grids = record.grids;
+		board.Move((Board::Direction)record.GetDirection());
+		if (record.spawn != 0)
+		{
+			int id, value;
+			GameBase::DecodeAction(record.spawn, id, value);
+			board.SetGrid(id, value);
+		}
+
+		expected[record.gameId] = board.grids;
+		maxValues[record.gameId] = max(maxValues[record.gameId], MaxValue(board.grids));
+		iterations += record.iterations;
+	}
+
+	float elapsed = chrono::duration<float>(chrono::steady_clock::now() - start).count();
+
+	array<int, 16> maxTiles = {};
+	for (auto &game : maxValues)
+		maxTiles[game.second]++;
+
+	printf("records: %zu, games: %zu, checksum errors: %lld, replay errors: %lld, iterations: %lld\n",
+		reader.GetCount(), maxValues.size(), checksumErrors, replayErrors, iterations);
+	printf("max tile:");
+	for (int i = 0; i < (int)maxTiles.size(); ++i)
+	{
+		if (maxTiles[i] > 0)
+			printf(" %d: %d", 1 << i, maxTiles[i]);
+	}
+	printf("\nread in %.3f s, %.1fM records/s\n", elapsed, reader.GetCount() / max(elapsed, 1e-6f) / 1e6f);
+	return 0;
+}
@@ -0,0 +1,249 @@
+#include "rollout.h"
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+const uint64_t GRID_LOW_BITS = 0x1111111111111111ULL;
+const uint64_t BYTE_LOW_BITS = 0x0f0f0f0f0f0f0f0fULL;
+
+static inline int RandomInt(uint64_t random, int n)
+{
+	return (int)(((random >> 32) * (uint64_t)n) >> 32);
+}
+
+static inline uint64_t Rotl(uint64_t x, int k)
+{
+	return (x << k) | (x >> (64 - k));
+}
+
+float BatchRollout::Run(const GameBase &game, int count, int fastStopStep, int estimateMax, Random &rng, RolloutStats &stats)
+{
+	count = clamp(count, 1, ROLLOUT_BATCH_MAX);
+
+	if (game.IsGameFinish())
+		return GameBase::CalcFinishScore(0) * count;
+
+	for (int i = 0; i < count; ++i)
+	{
+		grids[i] = game.board.grids;
+		state0[i] = rng.Next() | 1;
+		state1[i] = rng.Next();
+		bestValue[i] = 0;
+		lanes[i] = i;
+	}
+	laneCount = count;
+	valueSum = 0;
+
+	// all lanes start from the same state and move together, so they share the side and the step counters
+	int side = game.GetSide();
+	int turnCount = 0, estimateCount = 0;
+	int ended[ROLLOUT_BATCH_MAX];
+
+	while (laneCount > 0)
+	{
+		int endedCount = 0;
+		NextRandom(count);
+
+		if (side == Board::E_PLAYER)
+		{
+			for (int k = 0; k < laneCount; ++k)
+			{
+				if (!PlayerMove(lanes[k]))
+					ended[endedCount++] = lanes[k];
+			}
+		}
+		else // E_SYSTEM
+		{
+			UpdateEmpty(count);
+			for (int k = 0; k < laneCount; ++k)
+			{
+				int id = lanes[k];
+				Generate(id, random[id]);
+
+				if (emptyCount[id] == 1)
+				{
+					Board board;
+					board.grids = grids[id];
+					if (!board.Check(Board::E_UP) && !board.Check(Board::E_LEFT) && !board.Check(Board::E_RIGHT) && !board.Check(Board::E_DOWN))
+						ended[endedCount++] = id;
+				}
+			}
+		}
+		side = 1 - side;
+		stats.steps += laneCount;
+
+		if (++turnCount > fastStopStep)
+		{
+			UpdateEmpty(count);
+			bool stop = ++estimateCount > estimateMax;
+
+			for (int k = laneCount - 1; k >= 0; --k)
+			{
+				int id = lanes[k];
+				bestValue[id] = max(bestValue[id], GameBase::CalcFastStopScore((int)emptyCount[id]));
+			}
+
+			if (stop)
+			{
+				stats.fastStops += laneCount;
+				stats.fastStopSteps += laneCount * turnCount;
+				while (laneCount > 0)
+					Finish(laneCount - 1, bestValue[lanes[laneCount - 1]]);
+				break;
+			}
+		}
+
+		float finishValue = GameBase::CalcFinishScore((float)turnCount / fastStopStep);
+		for (int i = 0; i < endedCount; ++i)
+		{
+			for (int k = 0; k < laneCount; ++k)
+			{
+				if (lanes[k] == ended[i])
+				{
+					Finish(k, finishValue);
+					break;
+				}
+			}
+		}
+	}
+	return valueSum;
+}
+
+void BatchRollout::Finish(int id, float value)
+{
+	valueSum += value;
+	lanes[id] = lanes[--laneCount];
+}
+
+// xoroshiro128+ of every lane, the same generator as Random
+void BatchRollout::NextRandom(int count)
+{
+	int i = 0;
+#if defined(__AVX2__)
+	for (; i + 4 <= count; i += 4)
+	{
+		__m256i s0 = _mm256_load_si256((const __m256i*)&state0[i]);
+		__m256i s1 = _mm256_load_si256((const __m256i*)&state1[i]);
+		_mm256_store_si256((__m256i*)&random[i], _mm256_add_epi64(s0, s1));
+
+		s1 = _mm256_xor_si256(s1, s0);
+		s0 = _mm256_or_si256(_mm256_slli_epi64(s0, 24), _mm256_srli_epi64(s0, 40));
+		s0 = _mm256_xor_si256(_mm256_xor_si256(s0, s1), _mm256_slli_epi64(s1, 16));
+		s1 = _mm256_or_si256(_mm256_slli_epi64(s1, 37), _mm256_srli_epi64(s1, 27));
+
+		_mm256_store_si256((__m256i*)&state0[i], s0);
+		_mm256_store_si256((__m256i*)&state1[i], s1);
+	}
+#elif defined(__SSE2__) || defined(_M_X64)
+	for (; i + 2 <= count; i += 2)
+	{
+		__m128i s0 = _mm_load_si128((const __m128i*)&state0[i]);
+		__m128i s1 = _mm_load_si128((const __m128i*)&state1[i]);
+		_mm_store_si128((__m128i*)&random[i], _mm_add_epi64(s0, s1));
+
+		s1 = _mm_xor_si128(s1, s0);
+		s0 = _mm_or_si128(_mm_slli_epi64(s0, 24), _mm_srli_epi64(s0, 40));
+		s0 = _mm_xor_si128(_mm_xor_si128(s0, s1), _mm_slli_epi64(s1, 16));
+		s1 = _mm_or_si128(_mm_slli_epi64(s1, 37), _mm_srli_epi64(s1, 27));
+
+		_mm_store_si128((__m128i*)&state0[i], s0);
+		_mm_store_si128((__m128i*)&state1[i], s1);
+	}
+#endif
+	for (; i < count; ++i)
+	{
+		uint64_t s0 = state0[i];
+		uint64_t s1 = state1[i];
+		random[i] = s0 + s1;
+
+		s1 ^= s0;
+		state0[i] = Rotl(s0, 24) ^ s1 ^ (s1 << 16);
+		state1[i] = Rotl(s1, 37);
+	}
+}
+
+// the same bit tricks as Board::EmptyMask and Board::CountEmpty, the byte sums are done with sad
+void BatchRollout::UpdateEmpty(int count)
+{
+	int i = 0;
+#if defined(__AVX2__)
+	const __m256i low = _mm256_set1_epi64x(GRID_LOW_BITS);
+	const __m256i byteLow = _mm256_set1_epi64x(BYTE_LOW_BITS);
+	for (; i + 4 <= count; i += 4)
+	{
+		__m256i x = _mm256_load_si256((const __m256i*)&grids[i]);
+		x = _mm256_or_si256(x, _mm256_srli_epi64(x, 2));
+		x = _mm256_or_si256(x, _mm256_srli_epi64(x, 1));
+		__m256i mask = _mm256_andnot_si256(x, low);
+		_mm256_store_si256((__m256i*)&emptyMask[i], mask);
+
+		__m256i bytes = _mm256_and_si256(_mm256_add_epi64(mask, _mm256_srli_epi64(mask, 4)), byteLow);
+		_mm256_store_si256((__m256i*)&emptyCount[i], _mm256_sad_epu8(bytes, _mm256_setzero_si256()));
+	}
+#elif defined(__SSE2__) || defined(_M_X64)
+	const __m128i low = _mm_set1_epi64x(GRID_LOW_BITS);
+	const __m128i byteLow = _mm_set1_epi64x(BYTE_LOW_BITS);
+	for (; i + 2 <= count; i += 2)
+	{
+		__m128i x = _mm_load_si128((const __m128i*)&grids[i]);
+		x = _mm_or_si128(x, _mm_srli_epi64(x, 2));
+		x = _mm_or_si128(x, _mm_srli_epi64(x, 1));
+		__m128i mask = _mm_andnot_si128(x, low);
+		_mm_store_si128((__m128i*)&emptyMask[i], mask);
+
+		__m128i bytes = _mm_and_si128(_mm_add_epi64(mask, _mm_srli_epi64(mask, 4)), byteLow);
+		_mm_store_si128((__m128i*)&emptyCount[i], _mm_sad_epu8(bytes, _mm_setzero_si128()));
+	}
+#endif
+	for (; i < count; ++i)
+	{
+		uint64_t x = grids[i];
+		x |= x >> 2;
+		x |= x >> 1;
+		uint64_t mask = ~x & GRID_LOW_BITS;
+		emptyMask[i] = mask;
+
+		uint64_t bytes = (mask + (mask >> 4)) & BYTE_LOW_BITS;
+		emptyCount[i] = (bytes * 0x0101010101010101ULL) >> 56;
+	}
+}
+
+// returns false if the lane reached the win condition or had no move
+bool BatchRollout::PlayerMove(int lane)
+{
+	// same orders as GameBase::GetNaiveMove
+	const int *order = GameTypes::NAIVE_DIRECTION[RandomInt(random[lane], GameTypes::NAIVE_ORDER_NUM)];
+
+	for (int j = 0; j < Board::E_DIRECTION_MAX; ++j)
+	{
+		Board board;
+		board.grids = grids[lane];
+		if (board.Move((Board::Direction)order[j]))
+		{
+			grids[lane] = board.grids;
+			return board.maxValue < WIN_CONDITION;
+		}
+	}
+	return false;
+}
+
+// the grid comes from the high half of the random number like Random::NextInt, the value from the low half
+void BatchRollout::Generate(int lane, uint64_t r)
+{
+	int count = (int)emptyCount[lane];
+	int target = RandomInt(r, count);
+	int ratio = min(count + 3, 10);
+	int value = (((r & 0xffffffffULL) * ratio) >> 32) == 0 ? 2 : 1;
+
+	// the target-th set bit of the empty mask
+	uint64_t mask = emptyMask[lane];
+#if defined(__BMI2__)
+	uint64_t bit = _pdep_u64(1ULL << target, mask);
+#else
+	for (int i = 0; i < target; ++i)
+		mask &= mask - 1;
+	uint64_t bit = mask & (~mask + 1);
+#endif
+	grids[lane] |= bit * value;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include "game.h"
+
+const int ROLLOUT_BATCH_MAX = 32;
+
+struct RolloutStats
+{
+	int steps;
+	int fastStops;
+	int fastStopSteps;
+};
+
+// plays up to 32 naive rollouts of the same state in lockstep, every lane is a separate game.
+// lanes are stored as arrays (SoA), so random numbers and empty grids of all lanes are computed together,
+// with AVX2 when the compiler targets it, the results match GameBase::GetNextMove + MCTS::DefaultPolicy
+class BatchRollout
+{
+public:
+	// returns the sum of the values of count rollouts
+	float Run(const GameBase &game, int count, int fastStopStep, int estimateMax, Random &rng, RolloutStats &stats);
+
+private:
+	void NextRandom(int count);
+	void UpdateEmpty(int count);
+	bool PlayerMove(int lane);
+	void Generate(int lane, uint64_t random);
+	void Finish(int id, float value);
+
+	alignas(32) uint64_t grids[ROLLOUT_BATCH_MAX];
+	alignas(32) uint64_t state0[ROLLOUT_BATCH_MAX];
+	alignas(32) uint64_t state1[ROLLOUT_BATCH_MAX];
+	alignas(32) uint64_t random[ROLLOUT_BATCH_MAX];
+	alignas(32) uint64_t emptyMask[ROLLOUT_BATCH_MAX];
+	alignas(32) uint64_t emptyCount[ROLLOUT_BATCH_MAX];
+
+	float bestValue[ROLLOUT_BATCH_MAX];
+
+	// indices of the running lanes, a finished lane is swapped out
+	int lanes[ROLLOUT_BATCH_MAX];
+	int laneCount;
+	float valueSum;
+};
@@ -0,0 +1,134 @@
+#include "scheduler.h"
+#include <algorithm>
+
+SearchScheduler::SearchScheduler(int threadNum) : queues(max(threadNum > 0 ? threadNum : (int)thread::hardware_concurrency(), 1))
+{
+	nextQueue = 0;
+	steals = 0;
+	pendingTasks = 0;
+	stopping = false;
+
+	for (int i = 0; i < (int)queues.size(); ++i)
+		workers.push_back(thread(WorkerThread, i, this));
+}
+
+SearchScheduler::~SearchScheduler()
+{
+	{
+		lock_guard<mutex> lock(sleepMtx);
+		stopping = true;
+	}
+	sleepCv.notify_all();
+
+	for (auto &worker : workers)
+		worker.join();
+}
+
+// new tasks are spread round robin, stealing evens out the rest
+void SearchScheduler::Submit(Task task)
+{
+	WorkerQueue &queue = queues[nextQueue++ % queues.size()];
+	{
+		lock_guard<mutex> lock(queue.mtx);
+		queue.tasks.push_back(move(task));
+	}
+
+	{
+		lock_guard<mutex> lock(sleepMtx);
+		++pendingTasks;
+	}
+	sleepCv.notify_one();
+}
+
+void SearchScheduler::WorkerThread(int id, SearchScheduler *scheduler)
+{
+	WorkerQueue &own = scheduler->queues[id];
+
+	while (1)
+	{
+		Task task;
+		if (!scheduler->TakeTask(id, task))
+		{
+			unique_lock<mutex> lock(scheduler->sleepMtx);
+			scheduler->sleepCv.wait(lock, [scheduler]() { return scheduler->stopping || scheduler->pendingTasks > 0; });
+			if (scheduler->stopping)
+				return;
+			continue;
+		}
+
+		if (!task.run())
+			continue;
+
+		// the task goes on, it stays with this worker unless another one steals it
+		{
+			lock_guard<mutex> lock(own.mtx);
+			own.tasks.push_back(move(task));
+		}
+		{
+			lock_guard<mutex> lock(scheduler->sleepMtx);
+			++scheduler->pendingTasks;
+		}
+		scheduler->sleepCv.notify_one();
+	}
+}
+
+// the deadlines of all queues are compared, so a worker never runs its own later task while a search
+// close to its deadline waits in another queue. the own queue wins a tie
+bool SearchScheduler::TakeTask(int id, Task &task)
+{
+	int count = (int)queues.size();
+	while (1)
+	{
+		int best = -1;
+		chrono::steady_clock::time_point bestDeadline;
+		for (int i = 0; i < count; ++i)
+		{
+			chrono::steady_clock::time_point deadline;
+			if (PeekEarliest(queues[(id + i) % count], deadline) && (best < 0 || deadline < bestDeadline))
+			{
+				best = i;
+				bestDeadline = deadline;
+			}
+		}
+
+		if (best < 0)
+			return false;
+
+		// another worker may have taken it in the meantime, then the queues are scanned again
+		if (!PopEarliest(queues[(id + best) % count], task))
+			continue;
+
+		steals += (best > 0) ? 1 : 0;
+		lock_guard<mutex> lock(sleepMtx);
+		--pendingTasks;
+		return true;
+	}
+}
+
+bool SearchScheduler::PeekEarliest(WorkerQueue &queue, chrono::steady_clock::time_point &deadline)
+{
+	lock_guard<mutex> lock(queue.mtx);
+	if (queue.tasks.empty())
+		return false;
+
+	deadline = queue.tasks.front().deadline;
+	for (auto &task : queue.tasks)
+		deadline = min(deadline, task.deadline);
+	return true;
+}
+
+// queues hold a few tasks per engine, so a scan is cheaper than keeping them ordered
+bool SearchScheduler::PopEarliest(WorkerQueue &queue, Task &task)
+{
+	lock_guard<mutex> lock(queue.mtx);
+	if (queue.tasks.empty())
+		return false;
+
+	auto earliest = min_element(queue.tasks.begin(), queue.tasks.end(), [](const Task &a, const Task &b)
+	{
+		return a.deadline < b.deadline;
+	});
+	task = move(*earliest);
+	queue.tasks.erase(earliest);
+	return true;
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <chrono>
+#include <vector>
+
+using namespace std;
+
+// one pool of worker threads shared by many search engines, so games played at the same time
+// don't oversubscribe the machine. a task runs a slice of a search and asks to be queued again
+// while its search goes on. every worker keeps its own queue and runs the task with the earliest
+// deadline of all queues first, a task taken from another queue is a steal
+class SearchScheduler
+{
+public:
+	struct Task
+	{
+		function<bool()> run;	// returns true to be queued again
+		chrono::steady_clock::time_point deadline;
+	};
+
+	SearchScheduler(int threadNum = 0);
+	~SearchScheduler();
+
+	void Submit(Task task);
+	int GetThreadNum() const { return (int)workers.size(); }
+	long long GetSteals() const { return steals; }
+
+private:
+	struct alignas(64) WorkerQueue
+	{
+		mutex mtx;
+		deque<Task> tasks;
+	};
+
+	static void WorkerThread(int id, SearchScheduler *scheduler);
+	bool TakeTask(int id, Task &task);
+	static bool PeekEarliest(WorkerQueue &queue, chrono::steady_clock::time_point &deadline);
+	static bool PopEarliest(WorkerQueue &queue, Task &task);
+
+	vector<thread> workers;
+	vector<WorkerQueue> queues;
+	atomic<int> nextQueue;
+	atomic<long long> steals;
+
+	// idle workers sleep until a task is submitted
+	mutex sleepMtx;
+	condition_variable sleepCv;
+	atomic<int> pendingTasks;
+	bool stopping;
+};
@@ -0,0 +1,502 @@
+#include "game.h"
+#include "mcts.h"
+#include "ntuple.h"
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <sstream>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+// move decision daemon, one resident MCTS engine answers the requests of every session in arrival order.
+// a session is stdin/stdout or a connection to a unix domain socket, one request or reply per line:
+//   search <id> <budget ms> <16 tiles in row order, 0 for empty>
+//     -> move <id> <up|down|left|right|none> <search ms> <queue ms> <iterations>
+//     -> error <id> <reason> for a board with a winning tile or without a legal move
+//   stats -> stats requests <n> served <n> expired <n> rejected <n> queue <n> max_queue <n> mean_ms <x> p50_ms <x> p99_ms <x>
+//   quit  -> closes the session
+// a request that waited past most of its budget is answered with the greedy move instead of a search
+
+const int QUEUE_SIZE_DEFAULT = 64;
+const float SEARCH_TIME_MIN_MS = 5.f;		// below this a search is not worth starting
+const float BUDGET_RESERVE_MS = 2.f;		// kept from the budget for the reply
+const int LATENCY_WINDOW = 4096;			// latencies kept for the percentiles
+const int ACCEPT_BACKOFF_MIN_MS = 10;		// wait after a failed accept, doubled while it keeps failing
+const int ACCEPT_BACKOFF_MAX_MS = 1000;
+
+struct ServerConfig
+{
+	const char *socketPath;
+	int threads;
+	int transTableMB;
+	int queueSize;
+	int parallelMode;
+	const char *ntupleFile;
+};
+
+// replies of a session may come from the engine and from the reader, so writes are serialized
+class Session
+{
+public:
+	Session(int fd) : fd(fd), closed(false) {}
+	~Session()
+	{
+#ifndef _WIN32
+		if (fd >= 0)
+			close(fd);
+#endif
+	}
+
+	void Send(const string &line)
+	{
+		lock_guard<mutex> lock(writeMtx);
+		string text = line + "\n";
+		if (fd < 0)
+		{
+			fwrite(text.data(), 1, text.size(), stdout);
+			fflush(stdout);
+			return;
+		}
+#ifndef _WIN32
+		size_t sent = 0;
+		while (sent < text.size())
+		{
+			ssize_t n = send(fd, text.data() + sent, text.size() - sent, MSG_NOSIGNAL);
+			if (n <= 0)
+				return;
+			sent += n;
+		}
+#endif
+	}
+
+	int fd;					// -1 for stdin/stdout
+	atomic<bool> closed;	// the client is gone, its queued requests are dropped
+
+private:
+	mutex writeMtx;
+};
+
+struct Request
+{
+	shared_ptr<Session> session;
+	string id;
+	array<char, GRID_NUM> grids;
+	float budgetMs;
+	chrono::steady_clock::time_point received;
+};
+
+class MoveServer
+{
+public:
+	MoveServer(const ServerConfig &config, const NTuple *network);
+
+	void HandleLine(const shared_ptr<Session> &session, const string &line);
+	void Run();
+	void Stop();
+
+	void ReadSession(shared_ptr<Session> session);
+	bool Listen(const char *path);
+
+private:
+	bool ParseSearch(istringstream &in, Request &request, string &error);
+	void Serve(Request &request);
+	string FormatStats();
+
+	MCTS mcts;
+	int queueSize;
+
+	deque<Request> queue;
+	mutex queueMtx;
+	condition_variable queueCv;
+	bool stopping;
+
+	// metrics, guarded by queueMtx
+	long long requestCount, servedCount, expiredCount, rejectedCount;
+	int maxQueueDepth;
+	vector<float> latencies;
+	int latencyNext;
+};
+
+MoveServer::MoveServer(const ServerConfig &config, const NTuple *network) : mcts(config.parallelMode, config.threads, config.transTableMB)
+{
+	mcts.SetVerbose(false);
+	mcts.SetEvaluator(network);
+
+	queueSize = config.queueSize;
+	stopping = false;
+
+	requestCount = 0;
+	servedCount = 0;
+	expiredCount = 0;
+	rejectedCount = 0;
+	maxQueueDepth = 0;
+	latencyNext = 0;
+}
+
+bool MoveServer::ParseSearch(istringstream &in, Request &request, string &error)
+{
+	if (!(in >> request.id >> request.budgetMs) || request.budgetMs <= 0)
+	{
+		error = "expected: search <id> <budget ms> <16 tiles>";
+		return false;
+	}
+
+	// a board that is already won or lost has nothing to search
+	Board board;
+	board.Clear();
+	for (int i = 0; i < GRID_NUM; ++i)
+	{
+		long tile;
+		if (!(in >> tile) || tile < 0 || tile >= (1L << WIN_CONDITION) || (tile & (tile - 1)) != 0 || tile == 1)
+		{
+			error = "expected 16 tiles, each 0 or a power of two from 2 to " + to_string(1 << (WIN_CONDITION - 1));
+			return false;
+		}
+
+		int value = 0;
+		while ((1L << value) < tile)
+			++value;
+		request.grids[i] = (char)value;
+		board.SetGrid(i, value);
+	}
+
+	for (int d = 0; d < Board::E_DIRECTION_MAX; ++d)
+	{
+		if (board.Check((Board::Direction)d))
+			return true;
+	}
+	error = "the board has no legal move";
+	return false;
+}
+
+// called by the session readers, answers stats right away and queues searches
+void MoveServer::HandleLine(const shared_ptr<Session> &session, const string &line)
+{
+	istringstream in(line);
+	string command;
+	if (!(in >> command))
+		return;
+
+	if (command == "stats")
+	{
+		session->Send(FormatStats());
+		return;
+	}
+	if (command != "search")
+	{
+		session->Send("error - unknown command " + command);
+		return;
+	}
+
+	Request request;
+	string error;
+	request.session = session;
+	request.received = chrono::steady_clock::now();
+	if (!ParseSearch(in, request, error))
+	{
+		session->Send("error " + (request.id.empty() ? string("-") : request.id) + " " + error);
+		return;
+	}
+
+	{
+		lock_guard<mutex> lock(queueMtx);
+		++requestCount;
+		if ((int)queue.size() >= queueSize)
+		{
+			++rejectedCount;
+			session->Send("busy " + request.id);
+			return;
+		}
+
+		queue.push_back(move(request));
+		maxQueueDepth = max(maxQueueDepth, (int)queue.size());
+	}
+	queueCv.notify_one();
+}
+
+// the engine loop, returns after Stop once the queue is drained
+void MoveServer::Run()
+{
+	while (1)
+	{
+		Request request;
+		{
+			unique_lock<mutex> lock(queueMtx);
+			queueCv.wait(lock, [this]() { return stopping || !queue.empty(); });
+			if (queue.empty())
+				return;
+
+			request = move(queue.front());
+			queue.pop_front();
+		}
+
+		if (!request.session->closed)
+			Serve(request);
+	}
+}
+
+void MoveServer::Stop()
+{
+	{
+		lock_guard<mutex> lock(queueMtx);
+		stopping = true;
+	}
+	queueCv.notify_all();
+}
+
+void MoveServer::Serve(Request &request)
+{
+	auto start = chrono::steady_clock::now();
+	float waitMs = chrono::duration<float, milli>(start - request.received).count();
+	float remainingMs = request.budgetMs - waitMs - BUDGET_RESERVE_MS;
+
+	Game game(0);
+	game.SetBoard(request.grids);
+
+	int move = -1;
+	int iterations = 0;
+	bool expired = false;
+
+	if (!game.IsGameFinish())
+	{
+		if (remainingMs < SEARCH_TIME_MIN_MS)
+		{
+			// no time left to search, the greedy move is the best instant answer
+			move = ((GameBase*)&game)->GetGreedyMove();
+			expired = true;
+		}
+		else
+		{
+			mcts.SetSearchTime(remainingMs / 1000.f);
+			move = mcts.Search(&game);
+			iterations = mcts.GetLastStats().iteration;
+		}
+	}
+
+	auto end = chrono::steady_clock::now();
+	float searchMs = chrono::duration<float, milli>(end - start).count();
+	float latencyMs = chrono::duration<float, milli>(end - request.received).count();
+
+	char reply[256];
+	snprintf(reply, sizeof(reply), "move %s %s %.2f %.2f %d", request.id.c_str(), move < 0 ? "none" : Game::Move2Str(move).c_str(),
+		searchMs, waitMs, iterations);
+	request.session->Send(reply);
+
+	lock_guard<mutex> lock(queueMtx);
+	++servedCount;
+	expiredCount += expired ? 1 : 0;
+	if ((int)latencies.size() < LATENCY_WINDOW)
+		latencies.push_back(latencyMs);
+	else
+		latencies[latencyNext] = latencyMs;
+	latencyNext = (latencyNext + 1) % LATENCY_WINDOW;
+}
+
+string MoveServer::FormatStats()
+{
+	lock_guard<mutex> lock(queueMtx);
+
+	vector<float> sorted = latencies;
+	sort(sorted.begin(), sorted.end());
+	float sum = 0;
+	for (float latency : sorted)
+		sum += latency;
+
+	auto percentile = [&](float p) { return sorted.empty() ? 0.f : sorted[min((int)(p * sorted.size()), (int)sorted.size() - 1)]; };
+
+	char text[512];
+	snprintf(text, sizeof(text), "stats requests %lld served %lld expired %lld rejected %lld queue %d max_queue %d mean_ms %.2f p50_ms %.2f p99_ms %.2f",
+		requestCount, servedCount, expiredCount, rejectedCount, (int)queue.size(), maxQueueDepth,
+		sum / max((int)sorted.size(), 1), percentile(0.5f), percentile(0.99f));
+	return text;
+}
+
+// reads lines until the client closes or sends quit
+void MoveServer::ReadSession(shared_ptr<Session> session)
+{
+	if (session->fd < 0)
+	{
+		string line;
+		while (getline(cin, line) && line != "quit")
+			HandleLine(session, line);
+		return;
+	}
+
+#ifndef _WIN32
+	string buffer;
+	char chunk[4096];
+	while (1)
+	{
+		ssize_t n = recv(session->fd, chunk, sizeof(chunk), 0);
+		if (n <= 0)
+			break;
+
+		buffer.append(chunk, n);
+		size_t end;
+		while ((end = buffer.find('\n')) != string::npos)
+		{
+			string line = buffer.substr(0, end);
+			buffer.erase(0, end + 1);
+			if (!line.empty() && line.back() == '\r')
+				line.pop_back();
+
+			if (line == "quit")
+			{
+				session->closed = true;
+				return;
+			}
+			HandleLine(session, line);
+		}
+	}
+	session->closed = true;
+#endif
+}
+
+// accepts connections in a background thread, each session is read by a thread of its own
+bool MoveServer::Listen(const char *path)
+{
+#ifdef _WIN32
+	fprintf(stderr, "unix domain sockets are not supported on this platform\n");
+	return false;
+#else
+	int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+	sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	if (listenFd < 0 || strlen(path) >= sizeof(address.sun_path))
+	{
+		fprintf(stderr, "can't create socket %s\n", path);
+		return false;
+	}
+
+	strcpy(address.sun_path, path);
+	unlink(path);
+	if (bind(listenFd, (sockaddr*)&address, sizeof(address)) != 0 || listen(listenFd, SOMAXCONN) != 0)
+	{
+		fprintf(stderr, "can't listen on %s: %s\n", path, strerror(errno));
+		close(listenFd);
+		return false;
+	}
+
+	thread([this, listenFd]()
+	{
+		int backoffMs = 0;
+		while (1)
+		{
+			int fd = accept(listenFd, NULL, NULL);
+			if (fd < 0)
+			{
+				if (errno == EINTR || errno == ECONNABORTED)
+					continue;
+
+				// out of descriptors or memory, retrying at once would only spin until a session closes
+				backoffMs = clamp(backoffMs * 2, ACCEPT_BACKOFF_MIN_MS, ACCEPT_BACKOFF_MAX_MS);
+				fprintf(stderr, "can't accept a connection: %s, retrying in %d ms\n", strerror(errno), backoffMs);
+				this_thread::sleep_for(chrono::milliseconds(backoffMs));
+				continue;
+			}
+			backoffMs = 0;
+
+			thread(&MoveServer::ReadSession, this, make_shared<Session>(fd)).detach();
+		}
+	}).detach();
+	return true;
+#endif
+}
+
+static void PrintUsage()
+{
+	printf("usage: server [--socket PATH] [--threads T] [--tt-mb M] [--queue N] [--parallel tree|root] [--ntuple FILE]\n");
+	printf("  --socket   serve a unix domain socket instead of stdin/stdout\n");
+	printf("  --threads  search threads of the engine, 0 for hardware concurrency (default 0)\n");
+	printf("  --tt-mb    transposition table size (default %d)\n", TRANS_TABLE_SIZE_MB);
+	printf("  --queue    queued requests before new ones are answered busy (default %d)\n", QUEUE_SIZE_DEFAULT);
+	printf("  --parallel tree: threads share one tree, root: private trees merged at the root (default tree)\n");
+	printf("  --ntuple   n-tuple weights used by MCTS instead of rollouts\n");
+}
+
+static bool ParseArgs(int argc, char *argv[], ServerConfig &config)
+{
+	config.socketPath = NULL;
+	config.threads = 0;
+	config.transTableMB = TRANS_TABLE_SIZE_MB;
+	config.queueSize = QUEUE_SIZE_DEFAULT;
+	config.parallelMode = MCTS::E_TREE_PARALLEL;
+	config.ntupleFile = NULL;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (i + 1 >= argc)
+			return false;
+
+		const char *arg = argv[i];
+		const char *value = argv[++i];
+
+		if (strcmp(arg, "--socket") == 0)
+			config.socketPath = value;
+		else if (strcmp(arg, "--threads") == 0)
+			config.threads = atoi(value);
+		else if (strcmp(arg, "--tt-mb") == 0)
+			config.transTableMB = atoi(value);
+		else if (strcmp(arg, "--queue") == 0)
+			config.queueSize = atoi(value);
+		else if (strcmp(arg, "--parallel") == 0 && strcmp(value, "tree") == 0)
+			config.parallelMode = MCTS::E_TREE_PARALLEL;
+		else if (strcmp(arg, "--parallel") == 0 && strcmp(value, "root") == 0)
+			config.parallelMode = MCTS::E_ROOT_PARALLEL;
+		else if (strcmp(arg, "--ntuple") == 0)
+			config.ntupleFile = value;
+		else
+			return false;
+	}
+	return config.queueSize > 0;
+}
+
+int main(int argc, char *argv[])
+{
+	ServerConfig config;
+	if (!ParseArgs(argc, argv, config))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	NTuple network;
+	if (config.ntupleFile != NULL && !network.Load(config.ntupleFile))
+	{
+		fprintf(stderr, "can't load n-tuple weights from %s\n", config.ntupleFile);
+		return 1;
+	}
+
+	// the engine and its workers are created once and live as long as the server
+	MoveServer server(config, &network);
+
+	if (config.socketPath != NULL)
+	{
+		if (!server.Listen(config.socketPath))
+			return 1;
+
+		fprintf(stderr, "listening on %s\n", config.socketPath);
+		server.Run();
+		return 0;
+	}
+
+	// stdin/stdout, queued requests are still answered after the input ends
+	thread reader([&server]()
+	{
+		server.ReadSession(make_shared<Session>(-1));
+		server.Stop();
+	});
+	server.Run();
+	reader.join();
+	return 0;
+}
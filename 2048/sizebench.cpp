@@ -0,0 +1,208 @@
+#include "game.h"
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+
+// benchmarks the board sizes: raw move throughput on random boards and random play games,
+// sizes up to 4 are run with both the table and the direct merge path
+
+const int MOVE_BENCH_BOARDS = 4096;
+const int MOVE_BENCH_ROUNDS = 256;
+const int VERIFY_BOARDS = 100000;
+
+static volatile int benchSink; // keeps the timed moves from being optimized away
+
+// minimal game rules on a BoardN, so the table and merge paths can be played side by side
+template <int N, bool TABLE>
+class RandomGame
+{
+public:
+	RandomGame() : state(GameTypes::E_NORMAL), moves(0) {}
+
+	void Init(Random &rng)
+	{
+		board.Clear();
+		state = GameTypes::E_NORMAL;
+		moves = 0;
+		RandomGenerate(rng);
+		RandomGenerate(rng);
+	}
+
+	bool IsGameFinish() const { return state != GameTypes::E_NORMAL; }
+
+	bool Move(Board::Direction d, Random &rng)
+	{
+		if (!board.Move(d))
+			return false;
+
+		++moves;
+		RandomGenerate(rng);
+		CheckLoseCondition();
+		return true;
+	}
+
+	// picks one of the legal directions uniformly
+	int GetRandomMove(Random &rng) const
+	{
+		int legal[Board::E_DIRECTION_MAX];
+		int count = 0;
+		for (int d = 0; d < Board::E_DIRECTION_MAX; ++d)
+		{
+			if (board.Check((Board::Direction)d))
+				legal[count++] = d;
+		}
+		return count > 0 ? legal[rng.NextInt(count)] : -1;
+	}
+
+	BoardN<N, TABLE> board;
+	int state;
+	int moves;
+
+private:
+	void RandomGenerate(Random &rng)
+	{
+		int empty = board.CountEmpty();
+		if (empty == 0)
+			return;
+
+		int target = rng.NextInt(empty);
+		int value = (rng.NextInt(10) == 0) ? 2 : 1;
+		for (int i = 0; i < BoardN<N, TABLE>::GRID_NUM; ++i)
+		{
+			if (board.GetGrid(i) == 0 && target-- == 0)
+			{
+				board.SetGrid(i, value);
+				break;
+			}
+		}
+	}
+	void CheckLoseCondition()
+	{
+		if (board.CountEmpty() > 0)
+			return;
+		for (int d = 0; d < Board::E_DIRECTION_MAX; ++d)
+		{
+			if (board.Check((Board::Direction)d))
+				return;
+		}
+		state = GameTypes::E_LOSE;
+	}
+};
+
+template <int N, bool TABLE>
+static void RandomBoard(BoardN<N, TABLE> &board, Random &rng)
+{
+	board.Clear();
+	for (int i = 0; i < BoardN<N, TABLE>::GRID_NUM; ++i)
+		board.SetGrid(i, rng.NextInt(3) == 0 ? 0 : rng.NextInt(12));
+}
+
+// the generic board has to move exactly like the 4x4 bitboard, with and without tables
+static int Verify(Random &rng)
+{
+	int mismatch = 0;
+	for (int i = 0; i < VERIFY_BOARDS; ++i)
+	{
+		BoardN<4, true> table;
+		RandomBoard(table, rng);
+
+		BoardN<4, false> kernel;
+		Board board;
+		kernel.grids = table.grids;
+		for (int id = 0; id < GRID_NUM; ++id)
+			board.SetGrid(id, table.GetGrid(id));
+
+		for (int d = 0; d < Board::E_DIRECTION_MAX; ++d)
+		{
+			BoardN<4, true> a = table;
+			BoardN<4, false> b = kernel;
+			Board c = board;
+
+			bool changeA = a.Move((Board::Direction)d);
+			bool changeB = b.Move((Board::Direction)d);
+			bool changeC = c.Move((Board::Direction)d);
+
+			bool equal = (a.grids == b.grids) && changeA == changeB && changeA == changeC;
+			for (int id = 0; id < GRID_NUM; ++id)
+				equal = equal && a.GetGrid(id) == c.GetGrid(id);
+
+			mismatch += equal ? 0 : 1;
+		}
+	}
+	return mismatch;
+}
+
+template <int N, bool TABLE>
+static void Bench(const char *name, int games, uint64_t seed)
+{
+	Random rng(seed);
+
+	// moves of random boards, every direction is applied to a copy
+	vector<BoardN<N, TABLE>> boards(MOVE_BENCH_BOARDS);
+	for (auto &board : boards)
+		RandomBoard(board, rng);
+
+	int checksum = 0;
+	auto start = chrono::steady_clock::now();
+	for (int round = 0; round < MOVE_BENCH_ROUNDS; ++round)
+	{
+		for (auto &board : boards)
+		{
+			BoardN<N, TABLE> next = board;
+			checksum += next.Move((Board::Direction)(round & 3));
+		}
+	}
+	float moveTime = chrono::duration<float>(chrono::steady_clock::now() - start).count();
+	benchSink = checksum;
+
+	// random play until the board is stuck
+	long long moves = 0;
+	int maxValue = 0;
+	start = chrono::steady_clock::now();
+	for (int i = 0; i < games; ++i)
+	{
+		RandomGame<N, TABLE> game;
+		game.Init(rng);
+		while (!game.IsGameFinish())
+		{
+			int move = game.GetRandomMove(rng);
+			if (move < 0)
+				break;
+			game.Move((Board::Direction)move, rng);
+		}
+		moves += game.moves;
+		maxValue = max(maxValue, game.board.maxValue);
+	}
+	float gameTime = chrono::duration<float>(chrono::steady_clock::now() - start).count();
+
+	printf("%-10s moves/s: %6.1fM, games/s: %8.1f, game moves/s: %6.2fM, avg moves: %7.1f, max tile: %d\n",
+		name, (float)MOVE_BENCH_BOARDS * MOVE_BENCH_ROUNDS / max(moveTime, 1e-6f) / 1e6f,
+		games / max(gameTime, 1e-6f), moves / max(gameTime, 1e-6f) / 1e6f, (float)moves / games,
+		1 << maxValue);
+}
+
+int main(int argc, char *argv[])
+{
+	int games = 200;
+	uint64_t seed = 1;
+
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		if (strcmp(argv[i], "--games") == 0)
+			games = max(atoi(argv[i + 1]), 1);
+		else if (strcmp(argv[i], "--seed") == 0)
+			seed = atoi(argv[i + 1]);
+	}
+
+	Random rng(seed);
+	printf("verify 4x4 against the bitboard: %d mismatches\n", Verify(rng));
+
+	Bench<3, true>("3x3 table", games, seed);
+	Bench<3, false>("3x3 merge", games, seed);
+	Bench<4, true>("4x4 table", games, seed);
+	Bench<4, false>("4x4 merge", games, seed);
+	Bench<5, false>("5x5 merge", games, seed);
+	Bench<6, false>("6x6 merge", games, seed);
+
+	return 0;
+}
@@ -0,0 +1,251 @@
+#include "game.h"
+#include "ntuple.h"
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <cstring>
+#include <cstdlib>
+
+// offline TD(0) afterstate learning of an n-tuple network by self-play,
+// all threads update the shared weights without locks
+
+const float REPORT_INTERVAL = 10.f;
+
+struct TrainConfig
+{
+	int games;
+	int seed;
+	int threads;
+	float alpha;
+	int checkpointGames;
+	const char *loadFile;
+	const char *saveFile;
+};
+
+struct TrainStats
+{
+	atomic<int> games;
+	atomic<int> wins;
+	atomic<long long> moves;
+	atomic<long long> score;
+};
+
+static void PrintUsage()
+{
+	printf("usage: train [--games N] [--seed S] [--threads T] [--alpha A] [--checkpoint N] [--load FILE] [--save FILE]\n");
+	printf("  --games      self-play games to learn from (default 100000)\n");
+	printf("  --seed       seed of the first thread, thread i uses seed + i (default 1)\n");
+	printf("  --threads    training threads, 0 for hardware concurrency (default 0)\n");
+	printf("  --alpha      learning rate, shared by all the weights of a board (default 0.1)\n");
+	printf("  --checkpoint save the weights every N games (default 10000)\n");
+	printf("  --load       weights to continue from, default patterns start from zero\n");
+	printf("  --save       weights file (default ntuple.bin)\n");
+}
+
+static bool ParseArgs(int argc, char *argv[], TrainConfig &config)
+{
+	config.games = 100000;
+	config.seed = 1;
+	config.threads = 0;
+	config.alpha = 0.1f;
+	config.checkpointGames = 10000;
+	config.loadFile = NULL;
+	config.saveFile = "ntuple.bin";
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (i + 1 >= argc)
+			return false;
+
+		const char *arg = argv[i];
+		const char *value = argv[++i];
+
+		if (strcmp(arg, "--games") == 0)
+			config.games = atoi(value);
+		else if (strcmp(arg, "--seed") == 0)
+			config.seed = atoi(value);
+		else if (strcmp(arg, "--threads") == 0)
+			config.threads = atoi(value);
+		else if (strcmp(arg, "--alpha") == 0)
+			config.alpha = (float)atof(value);
+		else if (strcmp(arg, "--checkpoint") == 0)
+			config.checkpointGames = atoi(value);
+		else if (strcmp(arg, "--load") == 0)
+			config.loadFile = value;
+		else if (strcmp(arg, "--save") == 0)
+			config.saveFile = value;
+		else
+			return false;
+	}
+	return config.games > 0 && config.alpha > 0;
+}
+
+// the move maximizing reward + value of the afterstate, -1 if there is none
+static int SelectMove(const NTuple &network, const Board &board, int &reward, uint64_t &afterstate)
+{
+	int result = -1;
+	float bestValue = 0;
+
+	for (int d = 0; d < Board::E_DIRECTION_MAX; ++d)
+	{
+		Board next = board;
+		int score = next.GetMoveScore((Board::Direction)d);
+		if (!next.Move((Board::Direction)d))
+			continue;
+
+		float value = score + network.Evaluate(next.grids);
+		if (result < 0 || value > bestValue)
+		{
+			bestValue = value;
+			result = d;
+			reward = score;
+			afterstate = next.grids;
+		}
+	}
+	return result;
+}
+
+// plays one game greedily, then learns V(s') <- V(s') + alpha * (r' + V(s'') - V(s')) backwards over the afterstates
+static void PlayGame(NTuple &network, Random &rng, float alpha, vector<uint64_t> &afterstates, vector<int> &rewards, TrainStats &stats)
+{
+	GameBase game;
+	game.Init(rng);
+
+	afterstates.clear();
+	rewards.clear();
+	long long score = 0;
+
+	while (!game.IsGameFinish())
+	{
+		int reward;
+		uint64_t afterstate;
+		int move = SelectMove(network, game.board, reward, afterstate);
+		if (move < 0)
+			break;
+
+		game.Move(move);
+		afterstates.push_back(afterstate);
+		rewards.push_back(reward);
+		score += reward;
+
+		// the real spawn distribution, the rollout policy biases the spawns toward 4
+		if (!game.IsGameFinish())
+			game.RandomGenerate(rng);
+	}
+
+	float rate = alpha / max(network.GetFeatureCount(), 1);
+	float target = 0;
+	for (int i = (int)afterstates.size() - 1; i >= 0; --i)
+	{
+		float error = target - network.Evaluate(afterstates[i]);
+		network.Update(afterstates[i], rate * error);
+		target = rewards[i] + network.Evaluate(afterstates[i]);
+	}
+
+	stats.games++;
+	stats.wins += game.state == GameBase::E_WIN ? 1 : 0;
+	stats.moves += (long long)afterstates.size();
+	stats.score += score;
+}
+
+static void TrainThread(int id, const TrainConfig *config, NTuple *network, atomic<int> *nextGame, TrainStats *stats)
+{
+	Random rng(config->seed + id);
+	vector<uint64_t> afterstates;
+	vector<int> rewards;
+
+	while ((*nextGame)++ < config->games)
+		PlayGame(*network, rng, config->alpha, afterstates, rewards, *stats);
+}
+
+int main(int argc, char *argv[])
+{
+	TrainConfig config;
+	if (!ParseArgs(argc, argv, config))
+	{
+		PrintUsage();
+		return 1;
+	}
+
+	NTuple network;
+	if (config.loadFile != NULL)
+	{
+		if (!network.Load(config.loadFile))
+		{
+			printf("failed to load weights from %s\n", config.loadFile);
+			return 1;
+		}
+	}
+	else
+	{
+		network = NTuple(NTuple::DefaultPatterns());
+	}
+
+	int threadNum = config.threads > 0 ? config.threads : max((int)thread::hardware_concurrency(), 1);
+
+	TrainStats stats;
+	stats.games = 0;
+	stats.wins = 0;
+	stats.moves = 0;
+	stats.score = 0;
+	atomic<int> nextGame(0);
+
+	auto start = chrono::steady_clock::now();
+	vector<thread> threads;
+	for (int i = 0; i < threadNum; ++i)
+		threads.push_back(thread(TrainThread, i, &config, &network, &nextGame, &stats));
+
+	// report and checkpoint from the main thread while the workers play
+	int lastGames = 0, lastCheckpoint = 0;
+	long long lastScore = 0;
+	int lastWins = 0;
+	float lastReport = 0;
+
+	while (1)
+	{
+		this_thread::sleep_for(chrono::milliseconds(100));
+
+		int games = stats.games;
+		float elapsedTime = chrono::duration<float>(chrono::steady_clock::now() - start).count();
+		bool finish = games >= config.games;
+
+		if (finish || elapsedTime - lastReport >= REPORT_INTERVAL)
+		{
+			long long score = stats.score;
+			int wins = stats.wins;
+			int count = max(games - lastGames, 1);
+
+			printf("games: %d, games/s: %.1f, moves/s: %.0f, avg score: %.0f, win rate: %.2f%%\n",
+				games, (games - lastGames) / max(elapsedTime - lastReport, 1e-6f), stats.moves / max(elapsedTime, 1e-6f),
+				(float)(score - lastScore) / count, (wins - lastWins) * 100.f / count);
+			fflush(stdout);
+
+			lastGames = games;
+			lastScore = score;
+			lastWins = wins;
+			lastReport = elapsedTime;
+		}
+
+		if (finish)
+			break;
+
+		if (config.checkpointGames > 0 && games - lastCheckpoint >= config.checkpointGames)
+		{
+			if (!network.Save(config.saveFile))
+				printf("failed to save checkpoint to %s\n", config.saveFile);
+			lastCheckpoint = games;
+		}
+	}
+
+	for (auto &t : threads)
+		t.join();
+
+	if (!network.Save(config.saveFile))
+	{
+		printf("failed to save weights to %s\n", config.saveFile);
+		return 1;
+	}
+	printf("weights saved to %s\n", config.saveFile);
+
+	return 0;
+}
@@ -0,0 +1,169 @@
+#include "transposition.h"
+
+const uint64_t SYSTEM_SIDE_KEY = 0x9e3779b97f4a7c15ULL;
+
+static uint64_t MixHash(uint64_t x)
+{
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+	return x;
+}
+
+TranspositionTable::TranspositionTable(int sizeMB)
+{
+	// round down to a power of two number of buckets
+	uint64_t bucketCount = 0;
+	uint64_t maxBucketCount = ((uint64_t)max(sizeMB, 0) << 20) / (sizeof(Entry) * TRANS_TABLE_BUCKET_SIZE);
+	if (maxBucketCount > 0)
+	{
+		bucketCount = 1;
+		while (bucketCount * 2 <= maxBucketCount)
+			bucketCount *= 2;
+	}
+
+	entryCount = bucketCount * TRANS_TABLE_BUCKET_SIZE;
+	entries = entryCount > 0 ? new Entry[entryCount] : NULL;
+	for (uint64_t i = 0; i < entryCount; ++i)
+	{
+		entries[i].check = 0;
+		entries[i].data = 0;
+	}
+
+	generation = 0;
+	sliceBuckets = bucketCount;
+	sliceCount = 1;
+	Clear();
+	ResetStats();
+}
+
+TranspositionTable::~TranspositionTable()
+{
+	delete[] entries;
+}
+
+// entries of older generations are treated as empty, so clearing is O(1)
+void TranspositionTable::Clear()
+{
+	++generation;
+}
+
+// every slice is a table of its own, the private trees of a root-parallel search never share a bucket.
+// the entries are cleared when the split changes
+void TranspositionTable::Split(int count)
+{
+	if (!IsEnabled())
+		return;
+
+	count = clamp(count, 1, TRANS_TABLE_SLICE_MAX);
+	if (count == sliceCount)
+		return;
+
+	uint64_t buckets = 1;
+	while (buckets * 2 * count <= entryCount / TRANS_TABLE_BUCKET_SIZE)
+		buckets *= 2;
+
+	sliceBuckets = buckets;
+	sliceCount = count;
+	Clear();
+}
+
+int TranspositionTable::Lookup(uint64_t key, int slice)
+{
+	if (!IsEnabled())
+		return -1;
+
+	Counters &stats = counters[slice];
+	stats.lookup.fetch_add(1, memory_order_relaxed);
+
+	Entry *bucket = GetBucket(key, slice);
+	for (int i = 0; i < TRANS_TABLE_BUCKET_SIZE; ++i)
+	{
+		uint64_t data = bucket[i].data.load(memory_order_acquire);
+		uint64_t check = bucket[i].check.load(memory_order_relaxed);
+
+		if ((check ^ data) == key && (uint32_t)(data >> 32) == generation)
+		{
+			stats.hit.fetch_add(1, memory_order_relaxed);
+			return (int)(data & 0xffffffff);
+		}
+	}
+	return -1;
+}
+
+void TranspositionTable::Store(uint64_t key, int node, int slice)
+{
+	if (!IsEnabled())
+		return;
+
+	Counters &stats = counters[slice];
+	stats.store.fetch_add(1, memory_order_relaxed);
+
+	// take the first slot of an older generation, otherwise replace the first one
+	Entry *bucket = GetBucket(key, slice);
+	Entry *target = &bucket[0];
+	for (int i = 0; i < TRANS_TABLE_BUCKET_SIZE; ++i)
+	{
+		if ((uint32_t)(bucket[i].data.load(memory_order_relaxed) >> 32) != generation)
+		{
+			target = &bucket[i];
+			break;
+		}
+	}
+
+	uint64_t oldData = target->data.load(memory_order_relaxed);
+	if ((uint32_t)(oldData >> 32) == generation)
+		stats.collision.fetch_add(1, memory_order_relaxed);
+
+	uint64_t data = ((uint64_t)generation << 32) | (uint32_t)node;
+	target->check.store(key ^ data, memory_order_relaxed);
+	target->data.store(data, memory_order_release);
+}
+
+void TranspositionTable::ResetStats()
+{
+	for (auto &stats : counters)
+	{
+		stats.lookup = 0;
+		stats.hit = 0;
+		stats.store = 0;
+		stats.collision = 0;
+	}
+}
+
+void TranspositionTable::PrintStats()
+{
+	if (!IsEnabled())
+		return;
+
+	Stats stats = GetStats();
+	printf("trans table: %.0f MB, slices: %d, lookup: %d, hit: %.2f%%, store: %d, collision: %.2f%%\n",
+		entryCount * sizeof(Entry) / 1048576.f, sliceCount,
+		stats.lookup, stats.hit * 100.f / max(stats.lookup, 1),
+		stats.store, stats.collision * 100.f / max(stats.store, 1));
+}
+
+TranspositionTable::Stats TranspositionTable::GetStats() const
+{
+	Stats stats = {};
+	for (int i = 0; i < sliceCount; ++i)
+	{
+		stats.lookup += counters[i].lookup;
+		stats.hit += counters[i].hit;
+		stats.store += counters[i].store;
+		stats.collision += counters[i].collision;
+	}
+	return stats;
+}
+
+uint64_t TranspositionTable::MakeKey(uint64_t grids, int side)
+{
+	return grids ^ (side == Board::E_SYSTEM ? SYSTEM_SIDE_KEY : 0);
+}
+
+TranspositionTable::Entry* TranspositionTable::GetBucket(uint64_t key, int slice)
+{
+	return &entries[(slice * sliceBuckets + (MixHash(key) & (sliceBuckets - 1))) * TRANS_TABLE_BUCKET_SIZE];
+}
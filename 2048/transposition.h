@@ -0,0 +1,60 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include "game.h"
+
+const int TRANS_TABLE_SIZE_MB = 64;
+const int TRANS_TABLE_BUCKET_SIZE = 4;
+const int TRANS_TABLE_SLICE_MAX = 32;
+
+// maps a board + side to the tree node holding its statistics,
+// entries are verified with key ^ data so concurrent writes never produce a false hit
+class TranspositionTable
+{
+public:
+	TranspositionTable(int sizeMB = TRANS_TABLE_SIZE_MB);
+	~TranspositionTable();
+
+	void Clear();
+	void Split(int count);
+	int Lookup(uint64_t key, int slice = 0);
+	void Store(uint64_t key, int node, int slice = 0);
+	bool IsEnabled() const { return entryCount > 0; }
+
+	struct Stats
+	{
+		int lookup, hit, store, collision;
+	};
+
+	void ResetStats();
+	void PrintStats();
+	Stats GetStats() const;
+
+	// exact for a 4x4 board, the rows of a larger board are folded into the key
+	template <int N>
+	static uint64_t MakeKey(const GameBaseN<N> &game) { return MakeKey(FoldGrids(game.board.grids), game.GetSide()); }
+	static uint64_t MakeKey(uint64_t grids, int side);
+
+private:
+	struct Entry
+	{
+		atomic<uint64_t> check;
+		atomic<uint64_t> data;
+	};
+
+	// counters of one slice, on a cache line of their own
+	struct alignas(64) Counters
+	{
+		atomic<int> lookup, hit, store, collision;
+	};
+
+	Entry* GetBucket(uint64_t key, int slice);
+
+	Entry *entries;
+	uint64_t entryCount;
+	uint64_t sliceBuckets;	// buckets of a slice, a power of two
+	int sliceCount;
+	uint32_t generation;
+
+	Counters counters[TRANS_TABLE_SLICE_MAX];
+};